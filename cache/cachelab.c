@@ -13,12 +13,26 @@ int func_counter = 0;
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
  */
-void printSummary(int hits, int misses, int evictions)
+void printSummary(unsigned long long hits, unsigned long long misses,
+		  unsigned long long evictions)
 {
-	printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+	printf("hits:%llu misses:%llu evictions:%llu\n", hits, misses, evictions);
 	FILE* output_fp = fopen(".csim_results", "w");
 	assert(output_fp);
-	fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+	fprintf(output_fp, "%llu %llu %llu\n", hits, misses, evictions);
+	fclose(output_fp);
+}
+
+/*
+ * printTiming - Summarize the timing model estimates of the simulator.
+ *                They are also saved for test-trans in .csim_timing
+ */
+void printTiming(double amat, double cycles)
+{
+	printf("amat:%.2f cycles:%.0f\n", amat, cycles);
+	FILE* output_fp = fopen(".csim_timing", "w");
+	assert(output_fp);
+	fprintf(output_fp, "%f %f\n", amat, cycles);
 	fclose(output_fp);
 }
 
@@ -66,5 +80,7 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
 	func_list[func_counter].num_hits = 0;
 	func_list[func_counter].num_misses = 0;
 	func_list[func_counter].num_evictions =0;
+	func_list[func_counter].amat = 0;
+	func_list[func_counter].cycles = 0;
 	func_counter++;
 }
@@ -14,15 +14,24 @@ typedef struct trans_func{
   unsigned int num_hits;
   unsigned int num_misses;
   unsigned int num_evictions;
+  double amat;
+  double cycles;
 } trans_func_t;
 
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
  */ 
-void printSummary(int hits,  /* number of  hits */
-				  int misses, /* number of misses */
-				  int evictions); /* number of evictions */
+void printSummary(unsigned long long hits,  /* number of  hits */
+				  unsigned long long misses, /* number of misses */
+				  unsigned long long evictions); /* number of evictions */
+
+/*
+ * printTiming - Report the average memory access time and the estimated
+ * cycle count of a simulation
+ */
+void printTiming(double amat,    /* average cycles per access */
+				 double cycles); /* estimated total cycles */
 
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
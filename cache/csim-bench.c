@@ -0,0 +1,244 @@
+/*
+ * csim-bench.c - throughput benchmark and regression gate for csim.
+ *
+ * runs ./csim over synthetic traces from ./synthtrace, stored in the
+ * binary encoding, on several cache geometries and
+ * reports accesses per second and peak resident set size of each run.
+ * with -u the results are stored as the baseline; otherwise they are
+ * compared with the stored baseline and the benchmark fails (exit
+ * status 1) if any run got slower by more than the allowed percentage,
+ * or if the baseline has no entry for a run.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#define LEN 100
+
+/* at most this many trace sizes on the command line */
+#define MAX_SIZES 8
+
+/* cache geometries benchmarked: s, E, b */
+static const int geometry[][3] = {
+    {5, 1, 5},      /* the 1KB direct mapped cache of test-trans */
+    {10, 4, 6},     /* 256KB 4-way, 64B lines */
+    {13, 16, 6},    /* 8MB 16-way, 64B lines */
+};
+#define N_GEOMETRY ((int)(sizeof(geometry) / sizeof(geometry[0])))
+
+/* result of one benchmark run */
+struct result{
+    int s, E, b;
+    unsigned long long n;
+    double secs, rate;
+    long maxrss;
+};
+
+/* global vars */
+unsigned long long sizes[MAX_SIZES];
+int n_sizes = 0;
+int repeat = 3;
+double max_regress = 10;
+char baseline[LEN] = "bench.baseline";
+char update = 0;
+
+void usage(char *argv[]){
+    printf("Usage: %s [-hu] [-n <num>]... [-k <num>] [-r <pct>] [-f <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -u         Store results as the new baseline.\n");
+    printf("  -n <num>   Accesses per trace, may be repeated up to %d times\n"
+           "             (default 10000000).\n", MAX_SIZES);
+    printf("  -k <num>   Keep the best of num runs (default 3).\n");
+    printf("  -r <pct>   Allowed throughput regression in percent (default 10).\n");
+    printf("  -f <file>  Baseline file (default bench.baseline).\n");
+}
+
+/* parse command-line options using get-opt */
+void get_input(int argc, char *argv[]){
+    int optc = 0;
+    while((optc = getopt(argc, argv, "n:k:r:f:uh")) != -1){
+        switch (optc) {
+            case 'n':
+                if (n_sizes == MAX_SIZES){
+                    fprintf(stderr, "-n: at most %d sizes\n", MAX_SIZES);
+                    usage(argv);
+                    exit(1);
+                }
+                sizes[n_sizes++] = strtoull(optarg, NULL, 0);
+                break;
+            case 'k':
+                repeat = atoi(optarg);
+                break;
+            case 'r':
+                max_regress = atof(optarg);
+                break;
+            case 'f':
+                strncpy(baseline, optarg, LEN - 1);
+                break;
+            case 'u':
+                update = 1;
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+    if (!n_sizes)
+        sizes[n_sizes++] = 10000000;
+    if (repeat < 1)
+        repeat = 1;
+}
+
+/* generate a binary trace of n accesses with synthtrace, unless it is
+ * already there. the trace mixes streaming, zipfian hot lines and
+ * random accesses over 4MB footprints.
+ */
+void make_trace(const char *name, unsigned long long n){
+    struct stat st;
+    char cmd[2 * LEN];
+    if (stat(name, &st) == 0)
+        return;
+    printf("generating %s\n", name);
+    sprintf(cmd, "./synthtrace -B -m stream=3,zipf=1,random=1 -f 4194304 "
+            "-n %llu -o %s", n, name);
+    if (system(cmd)){
+        fprintf(stderr, "%s failed\n", cmd);
+        exit(1);
+    }
+}
+
+/* run csim once, filling in time and peak memory of the run */
+void run_csim(struct result *r, const char *trace){
+    char s[16], E[16], b[16];
+    struct timespec t0, t1;
+    struct rusage ru;
+    int status;
+    pid_t pid;
+    sprintf(s, "%d", r->s);
+    sprintf(E, "%d", r->E);
+    sprintf(b, "%d", r->b);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ((pid = fork()) == 0){
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, 1);
+        execl("./csim", "csim", "-s", s, "-E", E, "-b", b, "-t", trace,
+                (char*)NULL);
+        perror("./csim");
+        exit(1);
+    }
+    if (pid < 0 || wait4(pid, &status, 0, &ru) < 0){
+        perror("csim-bench");
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)){
+        fprintf(stderr, "csim failed on %s\n", trace);
+        exit(1);
+    }
+    r->secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    r->rate = r->n / r->secs;
+    r->maxrss = ru.ru_maxrss;
+}
+
+/* find the baseline rate of a run, 0 if there is none */
+double base_rate(FILE *fp, struct result *r){
+    int s, E, b;
+    unsigned long long n;
+    double rate;
+    if (!fp)
+        return 0;
+    rewind(fp);
+    while (fscanf(fp, "%d %d %d %llu %lf", &s, &E, &b, &n, &rate) == 5)
+        if (s == r->s && E == r->E && b == r->b && n == r->n)
+            return rate;
+    return 0;
+}
+
+/* main routine */
+int main(int argc, char *argv[])
+{
+    struct result res[MAX_SIZES * N_GEOMETRY], r;
+    char trace[LEN];
+    int i, j, k, n_res = 0, failed = 0, missing = 0;
+    FILE *fp;
+    get_input(argc, argv);
+
+    for (i = 0; i < n_sizes; i++){
+        sprintf(trace, "bench.%llu.bin", sizes[i]);
+        make_trace(trace, sizes[i]);
+        for (j = 0; j < N_GEOMETRY; j++){
+            struct result *best = &res[n_res++];
+            best->rate = 0;
+            r.s = geometry[j][0];
+            r.E = geometry[j][1];
+            r.b = geometry[j][2];
+            r.n = sizes[i];
+            for (k = 0; k < repeat; k++){
+                run_csim(&r, trace);
+                if (r.rate > best->rate)
+                    *best = r;
+            }
+        }
+    }
+
+    fp = fopen(baseline, "r");
+    printf("%3s %3s %3s %12s %9s %12s %10s  %s\n",
+            "s", "E", "b", "accesses", "secs", "acc/sec", "maxrss(KB)", "baseline");
+    for (i = 0; i < n_res; i++){
+        double base = update ? 0 : base_rate(fp, &res[i]);
+        printf("%3d %3d %3d %12llu %9.3f %12.0f %10ld  ", res[i].s, res[i].E,
+                res[i].b, res[i].n, res[i].secs, res[i].rate, res[i].maxrss);
+        if (update)
+            printf("-\n");
+        else if (!base){
+            printf("missing\n");
+            missing = 1;
+        }
+        else {
+            double change = (res[i].rate - base) / base * 100;
+            printf("%+.1f%%", change);
+            if (change < -max_regress){
+                printf(" REGRESSION");
+                failed = 1;
+            }
+            putchar('\n');
+        }
+    }
+    if (fp)
+        fclose(fp);
+
+    if (update){
+        fp = fopen(baseline, "w");
+        if (!fp){
+            perror(baseline);
+            return 1;
+        }
+        for (i = 0; i < n_res; i++)
+            fprintf(fp, "%d %d %d %llu %f\n", res[i].s, res[i].E, res[i].b,
+                    res[i].n, res[i].rate);
+        fclose(fp);
+        printf("baseline saved to %s\n", baseline);
+    }
+    else if (failed || missing){
+        if (missing)
+            printf("%s has no entry for some runs, store one with -u\n",
+                    baseline);
+        if (failed)
+            printf("throughput regressed by more than %g%%\n", max_regress);
+        return 1;
+    }
+    return 0;
+}
@@ -9,27 +9,68 @@
 #include <string.h>
 #include <unistd.h>
 #include "cachelab.h"
+#include "trace.h"
 #define LEN 100
 
 /* accepts short options with arguments */
-const char ac_opt[] = "s:E:b:t:hv";
+const char ac_opt[] = "s:E:b:t:c:r:n:H:L:B:P:hv";
 
 /* representing cache lines */
 struct cline{
 /* cache line's label */
     unsigned long long label;
 /* last time when this line was updated */
-    int timestamp;
+    unsigned long long timestamp;
 /* flag indicates availability */
     char flag;
 };
 
+/* header of a checkpoint file, followed by E * 2^s cache lines */
+struct ckpt{
+    char magic[8];
+/* geometry */
+    int s, E, b;
+/* counters, clock and memory operations */
+    unsigned long long hit, miss, evic;
+    unsigned long long t, ops;
+/* timing model: miss epochs and start of the current one */
+    unsigned long long epochs, epoch;
+/* trace being read and offset of the next access in it */
+    char tracefile[LEN];
+    long offset;
+/* trace_hash() of the trace up to offset, to recognise it on resume */
+    unsigned long long trace_hash;
+};
+
+#define CKPT_MAGIC "CSIMCKP4"
+
+/* bytes hashed at the start of a trace and before the saved offset */
+#define CKPT_SAMPLE 4096
+
 /* global vars */
 struct cline *cache;
-int s, E, b, t = 0;
-int hit = 0, miss = 0, evic = 0;
+int s, E, b;
+unsigned long long t = 0;
+/* memory operations simulated: a modify is one operation of two probes */
+unsigned long long ops = 0;
+unsigned long long hit = 0, miss = 0, evic = 0;
 char tracefile[LEN];
 char h = 0, v = 0;
+/* checkpoint to write at exit and to resume from */
+char ckpt_out[LEN], ckpt_in[LEN];
+/* stop after this many accesses, 0 for whole trace */
+unsigned long long max_acc = 0;
+
+/* timing model, see report_timing(). set when any parameter is given */
+char timing = 0;
+/* hit latency and memory latency in cycles */
+double hit_lat = 1, mem_lat = 100;
+/* memory bandwidth in bytes per cycle */
+double bandwidth = 8;
+/* misses within this many accesses of an epoch's first miss overlap */
+unsigned long long mlp = 1;
+/* number of miss epochs, and access count at start of current one */
+unsigned long long epochs = 0, epoch = 0;
 
 /* parse command-line options using get-opt */
 void get_input(int argc, char *argv[]){
@@ -50,6 +91,35 @@ void get_input(int argc, char *argv[]){
             case 't':
                 strncpy(tracefile, optarg, LEN);
                 break;
+            case 'c':
+                strncpy(ckpt_out, optarg, LEN - 1);
+                break;
+            case 'r':
+                strncpy(ckpt_in, optarg, LEN - 1);
+                break;
+            case 'n':
+                max_acc = strtoull(optarg, NULL, 0);
+                break;
+            case 'H':
+                hit_lat = atof(optarg);
+                timing = 1;
+                break;
+            case 'L':
+                mem_lat = atof(optarg);
+                timing = 1;
+                break;
+            case 'B':
+                bandwidth = atof(optarg);
+                if (bandwidth <= 0){
+                    fprintf(stderr, "-B: bandwidth must be above 0\n");
+                    exit(1);
+                }
+                timing = 1;
+                break;
+            case 'P':
+                mlp = strtoull(optarg, NULL, 0);
+                timing = 1;
+                break;
             case 'v':
                 v = 1;
                 break;
@@ -69,7 +139,8 @@ void load(unsigned long long addr)
     unsigned long long label = addr>>b;
     /* index of first cache line in set */
     int idx = E * (label&((1<<s) - 1));
-    int i, lru = ++t, empty = -1;
+    int i, empty = -1;
+    unsigned long long lru = ++t;
     for (i = 0; i < E; i++)
     {
         /* for a occupied cache line */
@@ -102,6 +173,11 @@ void load(unsigned long long addr)
     miss++;
     if (v)
         printf(" miss");
+    /* a miss too far from the epoch's first one cannot overlap with it */
+    if (!epochs || t - epoch >= mlp){
+        epochs++;
+        epoch = t;
+    }
     /* eviction occurs on non-empty lines */
     if (lru != t){
         evic ++;
@@ -119,43 +195,165 @@ void store(unsigned long long addr){
     load(addr);
 }
 
+/* estimate cycles spent on the accesses simulated so far.
+ * every cache access pays the hit latency (a modify makes two), every
+ * miss pays the transfer of one line at the given bandwidth, and every
+ * miss epoch pays the memory latency once: misses issued within mlp
+ * accesses of each other are assumed to be in flight together. AMAT is
+ * the average per memory operation.
+ */
+void report_timing(void){
+    double cycles = t * hit_lat + epochs * mem_lat
+        + miss * ((1 << b) / bandwidth);
+    printTiming(ops ? cycles / ops : 0, cycles);
+}
+
+/* FNV-1a hash of the first and the last CKPT_SAMPLE bytes of the first
+ * len bytes of a trace. a trace shorter than len hashes to 0.
+ */
+unsigned long long trace_hash(const char *name, long len){
+    unsigned long long hash = 14695981039346656037ULL;
+    long pos = 0;
+    int c;
+    FILE *fp = fopen(name, "rb");
+    if (!fp)
+        return 0;
+    while (pos < len && (c = getc(fp)) != EOF){
+        hash = (hash ^ c) * 1099511628211ULL;
+        /* skip the middle of a long prefix */
+        if (++pos == CKPT_SAMPLE && len - CKPT_SAMPLE > pos){
+            pos = len - CKPT_SAMPLE;
+            fseek(fp, pos, SEEK_SET);
+        }
+    }
+    fclose(fp);
+    return pos == len ? hash : 0;
+}
+
+/* save cache state and trace position, so the run can be resumed */
+void save_ckpt(long offset){
+    struct ckpt ck;
+    FILE *fp = fopen(ckpt_out, "wb");
+    if (!fp){
+        perror(ckpt_out);
+        exit(1);
+    }
+    memset(&ck, 0, sizeof(ck));
+    memcpy(ck.magic, CKPT_MAGIC, 8);
+    ck.s = s;
+    ck.E = E;
+    ck.b = b;
+    ck.hit = hit;
+    ck.miss = miss;
+    ck.evic = evic;
+    ck.t = t;
+    ck.ops = ops;
+    ck.epochs = epochs;
+    ck.epoch = epoch;
+    strncpy(ck.tracefile, tracefile, LEN - 1);
+    ck.offset = offset;
+    ck.trace_hash = trace_hash(tracefile, offset);
+    if (fwrite(&ck, sizeof(ck), 1, fp) != 1 ||
+            fwrite(cache, sizeof(struct cline), E * (1<<s), fp) != (size_t)(E * (1<<s))){
+        fprintf(stderr, "%s: write failed\n", ckpt_out);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+/* restore state saved by save_ckpt. returns the trace offset to resume
+ * from: the saved one if the same trace is simulated again (e.g. it was
+ * appended to), 0 if a new trace segment is given with -t. a trace of
+ * the saved name whose start or saved prefix changed is refused.
+ */
+long load_ckpt(void){
+    struct ckpt ck;
+    FILE *fp = fopen(ckpt_in, "rb");
+    if (!fp){
+        perror(ckpt_in);
+        exit(1);
+    }
+    if (fread(&ck, sizeof(ck), 1, fp) != 1 || memcmp(ck.magic, CKPT_MAGIC, 8)){
+        fprintf(stderr, "%s: not a checkpoint\n", ckpt_in);
+        exit(1);
+    }
+    /* geometry on command line, if any, must agree */
+    if ((s && s != ck.s) || (E && E != ck.E) || (b && b != ck.b)){
+        fprintf(stderr, "%s: saved with s=%d E=%d b=%d\n",
+                ckpt_in, ck.s, ck.E, ck.b);
+        exit(1);
+    }
+    s = ck.s;
+    E = ck.E;
+    b = ck.b;
+    hit = ck.hit;
+    miss = ck.miss;
+    evic = ck.evic;
+    t = ck.t;
+    ops = ck.ops;
+    epochs = ck.epochs;
+    epoch = ck.epoch;
+    cache = (struct cline*)malloc(sizeof(struct cline) * E * (1<<s));
+    if (fread(cache, sizeof(struct cline), E * (1<<s), fp) != (size_t)(E * (1<<s))){
+        fprintf(stderr, "%s: truncated checkpoint\n", ckpt_in);
+        exit(1);
+    }
+    fclose(fp);
+    if (!tracefile[0])
+        strncpy(tracefile, ck.tracefile, LEN - 1);
+    if (strcmp(tracefile, ck.tracefile))
+        return 0;
+    if (trace_hash(tracefile, ck.offset) != ck.trace_hash){
+        fprintf(stderr, "%s: %s changed since the checkpoint\n",
+                ckpt_in, tracefile);
+        exit(1);
+    }
+    return ck.offset;
+}
+
 /* main routine */
 int main(int argc, char *argv[])
 {
-    FILE *fp;
-    char tracebuf[LEN];
-    unsigned long add;
+    struct trace tr;
+    struct access acc;
+    long offset = 0;
+    unsigned long long n_acc = 0;
     get_input(argc, argv);
+    if (ckpt_in[0])
+        offset = load_ckpt();
+    else {
+        /* initialize cache */
+        cache = (struct cline*)malloc(sizeof(struct cline) * E * (1<<s));
+        memset(cache, 0, sizeof(struct cline) * E * (1<<s));
+    }
     if (v)
         printf("s:%d(%d), E:%d, b:%d(%d)\n", s, 1<<s, E, b, 1<<b);
-    /* initialize cache */
-    cache = (struct cline*)malloc(sizeof(struct cline) * E * (1<<s));
-    memset(cache, 0, sizeof(struct cline) * E * (1<<s));
     
-    fp = fopen(tracefile, "r");
-    /* read one line from file */
-    while (fgets(tracebuf, LEN, fp) != NULL) {
-        /* do nothing on instruction load */
-        if (tracebuf[0] == 'I'){
-            //if (v)
-                //printf("-----\n");
-            continue;
-        }
-        /* extract the address */
-        sscanf(tracebuf + 2, "%lx", &add);
+    if (open_trace(&tr, tracefile)){
+        perror(tracefile);
+        return 1;
+    }
+    if (offset)
+        fseek(tr.fp, offset, SEEK_SET);
+    /* read one access from file */
+    while ((!max_acc || n_acc < max_acc) && read_access(&tr, &acc)) {
+        n_acc++;
         if (v)
-            printf("%c at 0x%lx", tracebuf[1], add);
+            printf("%c at 0x%llx", acc.op, acc.addr);
         /* three types of operations (actually, nothing but load)*/
-        switch (tracebuf[1]) {
+        switch (acc.op) {
             case 'L':
-                load(add);
+                ops++;
+                load(acc.addr);
                 break;
             case 'S':
-                store(add);
+                ops++;
+                store(acc.addr);
                 break;
             case 'M':
-                load(add);
-                store(add);
+                ops++;
+                load(acc.addr);
+                store(acc.addr);
                 break;
             default:
                 break;
@@ -165,8 +363,12 @@ int main(int argc, char *argv[])
     }
     /* report the results */
     printSummary(hit, miss, evic);
+    if (timing)
+        report_timing();
+    if (ckpt_out[0])
+        save_ckpt(ftell(tr.fp));
     /* cleaning up */
-    fclose(fp);
+    close_trace(&tr);
     free(cache);
     return 0;
 }
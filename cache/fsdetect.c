@@ -0,0 +1,280 @@
+/*
+ * fsdetect.c - false sharing detector for thread-tagged memory traces.
+ *
+ * every write is charged to the cache line(s) it touches. a write by a
+ * thread other than the last writer of a line, less than a window of
+ * accesses after that write, moves ownership of the line, i.e. costs
+ * one invalidation. the invalidation is "false" when none of the
+ * written bytes was written by another thread in the last window
+ * accesses, "true" otherwise. the window slides with every access: each
+ * byte keeps its last writer and the time of that write. lines with
+ * false invalidations are reported, ranked by their count, with a map
+ * of which thread wrote which byte.
+ *
+ * trace format is the lackey format read by trace.c, with the thread
+ * tag as third field:  " S 601040,4,3"
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#define LEN 100
+
+/* thread ids must fit in a 64 bit writer set */
+#define MAX_THREADS 64
+/* byte maps cover lines of up to 64 bytes */
+#define MAX_B 6
+/* marks a byte written by more than one thread over the trace */
+#define SHARED 0xff
+
+/* accepts short options with arguments */
+const char ac_opt[] = "t:b:w:n:hv";
+
+/* statistics of one cache line */
+struct fline{
+/* line address (addr >> b), valid when used */
+    unsigned long long label;
+    char used;
+/* last thread that wrote the line, -1 if none, and when */
+    int last;
+    unsigned long long last_t;
+/* last writer of each byte, tid + 1 or 0 if none, and when */
+    unsigned char owner[1 << MAX_B];
+    unsigned long long when[1 << MAX_B];
+/* same as owner, but over the whole trace */
+    unsigned char all_owner[1 << MAX_B];
+/* set of threads that ever wrote the line */
+    unsigned long long writers;
+    unsigned long long writes, false_inv, true_inv;
+};
+
+/* global vars */
+struct fline *lines;
+unsigned long long n_lines = 0, cap = 1024;
+int b = 6, top = 20;
+unsigned long long window = 10000;
+char tracefile[LEN];
+char h = 0, v = 0;
+
+void usage(char *argv[]){
+    printf("Usage: %s [-hv] [-b <num>] [-w <num>] [-n <num>] -t <file>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Print byte maps of reported lines.\n");
+    printf("  -b <num>   Number of block offset bits (default 6, max %d).\n", MAX_B);
+    printf("  -w <num>   Sliding window length in accesses (default 10000).\n");
+    printf("  -n <num>   Number of lines to report (default 20).\n");
+    printf("  -t <file>  Thread-tagged trace file.\n");
+}
+
+/* parse command-line options using get-opt */
+void get_input(int argc, char *argv[]){
+    int optc = 0;
+    while((optc = getopt(argc, argv, ac_opt)) != -1){
+        switch (optc) {
+            case 't':
+                strncpy(tracefile, optarg, LEN - 1);
+                break;
+            case 'b':
+                b = atoi(optarg);
+                break;
+            case 'w':
+                window = strtoull(optarg, NULL, 0);
+                break;
+            case 'n':
+                top = atoi(optarg);
+                break;
+            case 'v':
+                v = 1;
+                break;
+            case 'h':
+                h = 1;
+                break;
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+}
+
+/* hash of a line label */
+static inline unsigned long long hash(unsigned long long label){
+    return (label * 0x9e3779b97f4a7c15ull) >> 17;
+}
+
+/* find the entry of a line, inserting it if absent */
+struct fline *lookup(unsigned long long label);
+
+/* double the table when it gets half full */
+void grow(void){
+    struct fline *old = lines;
+    unsigned long long i, old_cap = cap;
+    cap <<= 1;
+    lines = (struct fline*)calloc(cap, sizeof(struct fline));
+    if (!lines){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    n_lines = 0;
+    for (i = 0; i < old_cap; i++)
+        if (old[i].used)
+            *lookup(old[i].label) = old[i];
+    free(old);
+}
+
+struct fline *lookup(unsigned long long label){
+    unsigned long long i = hash(label) & (cap - 1);
+    while (lines[i].used){
+        if (lines[i].label == label)
+            return &lines[i];
+        i = (i + 1) & (cap - 1);
+    }
+    /* a new line */
+    if ((n_lines + 1) * 2 > cap){
+        grow();
+        return lookup(label);
+    }
+    n_lines++;
+    lines[i].used = 1;
+    lines[i].label = label;
+    lines[i].last = -1;
+    return &lines[i];
+}
+
+/* record a write of bytes [lo, hi) of a line by thread tid at time t */
+void write_line(unsigned long long label, int lo, int hi, int tid,
+        unsigned long long t){
+    struct fline *l = lookup(label);
+    int i, overlap = 0;
+    for (i = lo; i < hi; i++)
+        if (l->owner[i] && l->owner[i] != tid + 1 && t - l->when[i] < window)
+            overlap = 1;
+    /* ownership moves to another thread, unless the line went idle */
+    if (l->last >= 0 && l->last != tid && t - l->last_t < window){
+        if (overlap)
+            l->true_inv++;
+        else
+            l->false_inv++;
+    }
+    for (i = lo; i < hi; i++){
+        l->owner[i] = tid + 1;
+        l->when[i] = t;
+        if (!l->all_owner[i])
+            l->all_owner[i] = tid + 1;
+        else if (l->all_owner[i] != tid + 1)
+            l->all_owner[i] = SHARED;
+    }
+    l->last = tid;
+    l->last_t = t;
+    l->writers |= 1ull << tid;
+    l->writes++;
+}
+
+/* split a write into the lines it touches */
+void write_access(struct access *a, unsigned long long t){
+    unsigned long long addr = a->addr, end = a->addr + (a->size ? a->size : 1);
+    unsigned long long mask = (1ull << b) - 1;
+    while (addr < end){
+        unsigned long long next = (addr | mask) + 1;
+        if (next > end)
+            next = end;
+        write_line(addr >> b, addr & mask, ((next - 1) & mask) + 1, a->tid, t);
+        addr = next;
+    }
+}
+
+/* rank by false invalidations, then by all invalidations */
+int cmp_line(const void *x, const void *y){
+    const struct fline *p = x, *q = y;
+    if (p->false_inv != q->false_inv)
+        return p->false_inv < q->false_inv ? 1 : -1;
+    if (p->true_inv != q->true_inv)
+        return p->true_inv < q->true_inv ? 1 : -1;
+    return p->label < q->label ? -1 : p->label > q->label;
+}
+
+/* print which thread wrote each byte: tid in base 36, '.' or '*' */
+void print_map(unsigned char *owner){
+    const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    int i;
+    printf("    ");
+    for (i = 0; i < (1 << b); i++){
+        if (!owner[i])
+            putchar('.');
+        else if (owner[i] == SHARED)
+            putchar('*');
+        else if (owner[i] - 1 < 36)
+            putchar(digits[owner[i] - 1]);
+        else
+            putchar('+');
+    }
+    putchar('\n');
+}
+
+/* report the lines suffering from false sharing */
+void report(unsigned long long accesses){
+    unsigned long long i, j, n = 0;
+    int k;
+    for (i = 0; i < cap; i++)
+        if (lines[i].used && lines[i].false_inv)
+            lines[n++] = lines[i];
+    qsort(lines, n, sizeof(struct fline), cmp_line);
+    printf("accesses:%llu lines:%llu falsely shared:%llu\n",
+            accesses, n_lines, n);
+    if (n)
+        printf("%18s %10s %10s %10s  %s\n",
+                "line", "false-inv", "true-inv", "writes", "threads");
+    for (j = 0; j < n && j < (unsigned long long)top; j++){
+        printf("%#18llx %10llu %10llu %10llu ", lines[j].label << b,
+                lines[j].false_inv, lines[j].true_inv, lines[j].writes);
+        for (k = 0; k < MAX_THREADS; k++)
+            if (lines[j].writers & (1ull << k))
+                printf(" %d", k);
+        putchar('\n');
+        if (v)
+            print_map(lines[j].all_owner);
+    }
+}
+
+/* main routine */
+int main(int argc, char *argv[])
+{
+    struct trace tr;
+    struct access acc;
+    unsigned long long t = 0;
+    get_input(argc, argv);
+    if (h){
+        usage(argv);
+        return 0;
+    }
+    if (b < 0 || b > MAX_B || window == 0 || !tracefile[0]){
+        usage(argv);
+        return 1;
+    }
+    if (open_trace(&tr, tracefile)){
+        perror(tracefile);
+        return 1;
+    }
+    lines = (struct fline*)calloc(cap, sizeof(struct fline));
+    if (!lines){
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    while (read_access(&tr, &acc)) {
+        if (acc.tid < 0 || acc.tid >= MAX_THREADS){
+            fprintf(stderr, "thread id %d out of range [0, %d)\n",
+                    acc.tid, MAX_THREADS);
+            return 1;
+        }
+        /* loads never invalidate other copies */
+        if (acc.op == 'S' || acc.op == 'M')
+            write_access(&acc, t);
+        t++;
+    }
+    report(t);
+    close_trace(&tr);
+    free(lines);
+    return 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * synthtrace.c - synthetic memory trace generator with tunable locality.
+ *
+ * produces traces of any length from parametric access models:
+ *   stream   sequential accesses, wrapping around the footprint
+ *   stride   accesses a fixed stride apart, shifted on every wrap
+ *   random   uniformly random accesses within the footprint
+ *   zipf     zipfian popularity over the lines of the footprint: a few
+ *            hot lines get most accesses, scattered over the footprint
+ *   chase    pointer chasing through one random cycle of lines
+ * a mix is given as model=weight pairs, e.g. "stream=3,zipf=1": every
+ * access picks a model with probability proportional to its weight.
+ * every model of a mix works on its own region of the address space.
+ *
+ * the same seed always gives the same trace. output is lackey text,
+ * as read by csim, or with -B the compact binary encoding of trace.h.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trace.h"
+#define LEN 100
+
+/* lines are the unit of zipf and chase models */
+#define LINE 64
+/* at most this many models in a mix */
+#define MAX_MODELS 8
+/* models work in regions this far apart */
+#define REGION (1ull << 36)
+
+enum kind { STREAM, STRIDE, RANDOM, ZIPF, CHASE };
+static const char *kind_name[] = {"stream", "stride", "random", "zipf", "chase"};
+#define N_KINDS ((int)(sizeof(kind_name) / sizeof(kind_name[0])))
+
+/* state of one model */
+struct model{
+    enum kind kind;
+    double weight;
+    unsigned long long base;
+/* next offset for stream and stride, current line for chase */
+    unsigned long long pos;
+/* zipf: cumulative distribution over line ranks */
+    double *cdf;
+/* chase: successor of each line in the cycle */
+    unsigned int *next;
+};
+
+/* global vars */
+struct model models[MAX_MODELS];
+int n_models = 0;
+double total_weight = 0;
+unsigned long long n_acc = 1000000, seed = 1;
+unsigned long long footprint = 1 << 20, stride = LINE;
+unsigned long long n_lines;
+double zipf_s = 0.99, wr_frac = 0.25;
+int acc_size = 4;
+char outfile[LEN];
+char binary = 0;
+
+/* random number generator state */
+unsigned long long rng;
+
+/* splitmix64: fast and good enough, deterministic for a seed */
+static inline unsigned long long next_rand(void){
+    unsigned long long z = (rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* uniform double in [0, 1) */
+static inline double rand_unit(void){
+    return (next_rand() >> 11) * (1.0 / (1ull << 53));
+}
+
+/* uniform integer in [0, n) */
+static inline unsigned long long rand_below(unsigned long long n){
+    return next_rand() % n;
+}
+
+void usage(char *argv[]){
+    printf("Usage: %s [-hB] [-m <models>] [-n <num>] [-s <seed>] [-f <bytes>]\n"
+           "       [-d <bytes>] [-z <exp>] [-w <frac>] [-a <bytes>] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -B          Write the compact binary encoding.\n");
+    printf("  -m <models> Model or mix, e.g. zipf or stream=3,random=1 (default stream).\n");
+    printf("              Models: stream stride random zipf chase.\n");
+    printf("  -n <num>    Number of accesses (default 1000000).\n");
+    printf("  -s <seed>   Random seed (default 1).\n");
+    printf("  -f <bytes>  Footprint of each model (default 1048576).\n");
+    printf("  -d <bytes>  Stride of the stride model (default %d).\n", LINE);
+    printf("  -z <exp>    Exponent of the zipf model (default 0.99).\n");
+    printf("  -w <frac>   Fraction of stores (default 0.25).\n");
+    printf("  -a <bytes>  Access size (default 4).\n");
+    printf("  -o <file>   Output file (default stdout).\n");
+}
+
+/* parse a mix like "stream=3,zipf=1" */
+void parse_models(char *arg, char *argv[]){
+    char *tok, *eq;
+    int k;
+    for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")){
+        if (n_models == MAX_MODELS){
+            fprintf(stderr, "at most %d models\n", MAX_MODELS);
+            exit(1);
+        }
+        models[n_models].weight = 1;
+        if ((eq = strchr(tok, '=')) != NULL){
+            *eq = '\0';
+            models[n_models].weight = atof(eq + 1);
+        }
+        for (k = 0; k < N_KINDS; k++)
+            if (!strcmp(tok, kind_name[k]))
+                break;
+        if (k == N_KINDS || models[n_models].weight <= 0){
+            fprintf(stderr, "bad model: %s\n", tok);
+            usage(argv);
+            exit(1);
+        }
+        models[n_models].kind = k;
+        total_weight += models[n_models].weight;
+        n_models++;
+    }
+}
+
+/* parse command-line options using get-opt */
+void get_input(int argc, char *argv[]){
+    int optc = 0;
+    while((optc = getopt(argc, argv, "m:n:s:f:d:z:w:a:o:Bh")) != -1){
+        switch (optc) {
+            case 'm':
+                parse_models(optarg, argv);
+                break;
+            case 'n':
+                n_acc = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'f':
+                footprint = strtoull(optarg, NULL, 0);
+                break;
+            case 'd':
+                stride = strtoull(optarg, NULL, 0);
+                break;
+            case 'z':
+                zipf_s = atof(optarg);
+                break;
+            case 'w':
+                wr_frac = atof(optarg);
+                break;
+            case 'a':
+                acc_size = atoi(optarg);
+                break;
+            case 'o':
+                strncpy(outfile, optarg, LEN - 1);
+                break;
+            case 'B':
+                binary = 1;
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+    if (!n_models){
+        char dflt[] = "stream";
+        parse_models(dflt, argv);
+    }
+    if (acc_size < 1 || acc_size > LINE || footprint < LINE || !stride){
+        usage(argv);
+        exit(1);
+    }
+}
+
+void *xmalloc(size_t sz){
+    void *p = malloc(sz);
+    if (!p){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* set up the tables of zipf and chase models */
+void init_model(struct model *m, int i){
+    unsigned long long j, k;
+    unsigned int t;
+    m->base = REGION * (i + 1);
+    m->pos = 0;
+    switch (m->kind){
+        case ZIPF:
+            m->cdf = xmalloc(n_lines * sizeof(double));
+            for (j = 0; j < n_lines; j++)
+                m->cdf[j] = (j ? m->cdf[j - 1] : 0) + 1 / pow(j + 1, zipf_s);
+            for (j = 0; j < n_lines; j++)
+                m->cdf[j] /= m->cdf[n_lines - 1];
+            break;
+        case CHASE:
+            /* sattolo's algorithm gives a single cycle through all lines */
+            m->next = xmalloc(n_lines * sizeof(unsigned int));
+            for (j = 0; j < n_lines; j++)
+                m->next[j] = j;
+            for (j = n_lines - 1; j > 0; j--){
+                k = rand_below(j);
+                t = m->next[j];
+                m->next[j] = m->next[k];
+                m->next[k] = t;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* line of the given popularity rank. ranks are scattered over the
+ * footprint by multiplying with an odd constant, a bijection modulo
+ * the power of two n_lines.
+ */
+static inline unsigned long long rank_line(unsigned long long r){
+    return (r * 0x9e3779b97f4a7c15ull) & (n_lines - 1);
+}
+
+/* offset of the next access of a model within its region */
+unsigned long long next_offset(struct model *m){
+    unsigned long long off, lo, hi, mid;
+    double u;
+    switch (m->kind){
+        case STREAM:
+            off = m->pos;
+            m->pos = (m->pos + acc_size) % footprint;
+            return off;
+        case STRIDE:
+            off = m->pos;
+            m->pos += stride;
+            /* start the next sweep one access further */
+            if (m->pos + acc_size > footprint)
+                m->pos = (m->pos % stride + acc_size) % stride % footprint;
+            return off;
+        case RANDOM:
+            return rand_below(footprint / acc_size) * acc_size;
+        case ZIPF:
+            u = rand_unit();
+            lo = 0;
+            hi = n_lines - 1;
+            while (lo < hi){
+                mid = (lo + hi) / 2;
+                if (m->cdf[mid] < u)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return rank_line(lo) * LINE + rand_below(LINE / acc_size) * acc_size;
+        case CHASE:
+            /* load the pointer at the start of the line */
+            off = m->pos * LINE;
+            m->pos = m->next[m->pos];
+            return off;
+    }
+    return 0;
+}
+
+/* main routine */
+int main(int argc, char *argv[])
+{
+    FILE *fp = stdout;
+    struct access acc;
+    struct model *m;
+    unsigned long long i;
+    int j;
+    double u;
+    get_input(argc, argv);
+    rng = seed;
+    /* zipf and chase work on a power of two number of lines */
+    for (n_lines = 1; n_lines * 2 * LINE <= footprint; n_lines *= 2)
+        ;
+    for (j = 0; j < n_models; j++)
+        init_model(&models[j], j);
+    if (outfile[0] && !(fp = fopen(outfile, "w"))){
+        perror(outfile);
+        return 1;
+    }
+    if (binary)
+        put_magic(fp);
+    acc.tid = 0;
+    for (i = 0; i < n_acc; i++){
+        /* pick a model of the mix */
+        m = &models[0];
+        if (n_models > 1){
+            u = rand_unit() * total_weight;
+            for (j = 0; j < n_models - 1 && u >= models[j].weight; j++)
+                u -= models[j].weight;
+            m = &models[j];
+        }
+        acc.addr = m->base + next_offset(m);
+        acc.size = m->kind == CHASE ? 8 : acc_size;
+        acc.op = m->kind != CHASE && rand_unit() < wr_frac ? 'S' : 'L';
+        put_access(fp, &acc, binary);
+    }
+    if (fp != stdout)
+        fclose(fp);
+    for (j = 0; j < n_models; j++){
+        free(models[j].cdf);
+        free(models[j].next);
+    }
+    return 0;
+}
@@ -32,6 +32,9 @@ extern int func_counter;
 static int M = 0;
 static int N = 0;
 
+/* Timing model parameters passed to csim (see csim.c) */
+static char timing_args[64] = "-H 1 -L 100 -B 8 -P 1";
+
 /* Other globals */
 static int A[MAXN][MAXN];
 static int B[MAXN][MAXN]; 
@@ -96,6 +99,17 @@ void eval_correctness(int A[N][M], int B[M][N], int C[M][N])
 	}
 }
 
+/*
+ * run_cmd - Run a shell command, exiting if it fails
+ */
+static void run_cmd(const char *cmd)
+{
+	if (system(cmd) != 0) {
+		fprintf(stderr, "Command failed: %s\n", cmd);
+		exit(1);
+	}
+}
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
@@ -112,12 +126,15 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 	/* Use valgrind to generate traces of all of the registered trace
 	   functions in a single trace file */
 	sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d  > trace.all", M, N);
-	system(cmd);
+	run_cmd(cmd);
   
 	/* Get the start and end marker addresses */
 	FILE* marker_fp = fopen(".marker", "r");
 	assert(marker_fp);
-	fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
+	if (fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end) != 2) {
+		fprintf(stderr, "Unable to read the markers from .marker\n");
+		exit(1);
+	}
 	fclose(marker_fp);
 
 	/* Open the complete trace file */
@@ -175,12 +192,15 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 		char cmd[255];
 		sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
 				s, E, b, i);
-		system(cmd);
+		run_cmd(cmd);
     
 		/* Collect results from the reference simulator */
 		FILE* in_fp = fopen(".csim_results","r");
 		assert(in_fp);
-		fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
+		if (fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions) != 3) {
+			fprintf(stderr, "Unable to read .csim_results\n");
+			exit(1);
+		}
 		fclose(in_fp);
 		func_list[i].num_hits = hits;
 		func_list[i].num_misses = misses;
@@ -188,6 +208,22 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 		printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
 			   i, func_list[i].description, hits, misses, evictions);
     
+		/* Estimate the running time with our simulator's timing model */
+		sprintf(cmd, "./csim -s %u -E %u -b %u -t trace.f%d %s > /dev/null",
+				s, E, b, i, timing_args);
+		run_cmd(cmd);
+		in_fp = fopen(".csim_timing", "r");
+		assert(in_fp);
+		if (fscanf(in_fp, "%lf %lf", &func_list[i].amat,
+				   &func_list[i].cycles) != 2) {
+			fprintf(stderr, "Unable to read .csim_timing\n");
+			exit(1);
+		}
+		fclose(in_fp);
+		printf("func %u (%s): amat:%.2f, cycles:%.0f\n",
+			   i, func_list[i].description, func_list[i].amat,
+			   func_list[i].cycles);
+
 		/* If it is transpose_submit(), record number of misses */
 		if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0) {
 			results.misses = misses;
@@ -197,15 +233,49 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 	fclose(full_trace_fp);
 }
 
+/*
+ * cmp_cycles - Order transpose funcs by estimated cycles
+ */
+static int cmp_cycles(const void *x, const void *y)
+{
+	const trans_func_t *f = *(trans_func_t * const *)x;
+	const trans_func_t *g = *(trans_func_t * const *)y;
+	return (f->cycles > g->cycles) - (f->cycles < g->cycles);
+}
+
+/*
+ * rank_perf - Rank the registered transpose funcs by estimated time
+ */
+void rank_perf()
+{
+	int i;
+	trans_func_t *order[MAX_TRANS_FUNCS];
+
+	printf("\nStep 4: Ranking registered transpose funcs by estimated cycles (%s)\n",
+		   timing_args);
+	for (i=0; i<func_counter; i++)
+		order[i] = &func_list[i];
+	qsort(order, func_counter, sizeof(order[0]), cmp_cycles);
+	for (i=0; i<func_counter; i++) {
+		printf("%d. func %d (%s): cycles:%.0f, amat:%.2f, misses:%u\n",
+			   i + 1, (int)(order[i] - func_list), order[i]->description,
+			   order[i]->cycles, order[i]->amat, order[i]->num_misses);
+	}
+}
+
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-	printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+	printf("Usage: %s [-h] [-H <cyc>] [-L <cyc>] [-B <bytes>] [-P <acc>] -M <rows> -N <cols>\n", argv[0]);
 	printf("Options:\n");
 	printf("  -h          Print this help message.\n");
 	printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
 	printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+	printf("  -H <cyc>    Cache hit latency for the timing model (default 1)\n");
+	printf("  -L <cyc>    Memory latency for the timing model (default 100)\n");
+	printf("  -B <bytes>  Memory bandwidth per cycle (default 8)\n");
+	printf("  -P <acc>    Memory-level parallelism window in accesses (default 1)\n");
 	printf("Example: %s -M 8 -N 8\n", argv[0]);	  
 }
 
@@ -235,9 +305,23 @@ void sigalrm_handler(int signum){
 int main(int argc, char* argv[])
 {
 	char c;
+	double hit_lat = 1, mem_lat = 100, bandwidth = 8;
+	int mlp = 1;
 
-	while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+	while ((c = getopt(argc,argv,"M:N:H:L:B:P:h")) != -1) {
 		switch(c) {
+		case 'H':
+			hit_lat = atof(optarg);
+			break;
+		case 'L':
+			mem_lat = atof(optarg);
+			break;
+		case 'B':
+			bandwidth = atof(optarg);
+			break;
+		case 'P':
+			mlp = atoi(optarg);
+			break;
 		case 'M':
 			M = atoi(optarg);
 			break;
@@ -259,6 +343,9 @@ int main(int argc, char* argv[])
 		exit(1);
 	}
 
+	snprintf(timing_args, sizeof(timing_args), "-H %g -L %g -B %g -P %d",
+			hit_lat, mem_lat, bandwidth, mlp);
+
 	if (M > MAXN || N > MAXN) {
 		printf("Error: M or N exceeds %d\n", MAXN);
 		usage(argv);
@@ -284,6 +371,9 @@ int main(int argc, char* argv[])
 
 	/* Check the performance of the student's transpose function */
 	eval_perf(5, 1, 5);
+
+	/* Rank them by the time they would take */
+	rank_perf();
   
 	/* Emit the results for this particular test */
 	if (results.funcid == -1) {
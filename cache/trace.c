@@ -0,0 +1,122 @@
+/*
+ * trace.c - reader and writer for memory traces
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+#define LEN 100
+
+/* ops in the order of their binary codes */
+static const char ops[] = "LSM";
+
+int open_trace(struct trace *tr, const char *name)
+{
+    char magic[8];
+    tr->fp = fopen(name, "r");
+    if (!tr->fp)
+        return -1;
+    /* binary traces are recognised by their magic */
+    tr->binary = fread(magic, 1, 8, tr->fp) == 8 &&
+        !memcmp(magic, TRACE_MAGIC, 8);
+    if (!tr->binary)
+        rewind(tr->fp);
+    return 0;
+}
+
+void close_trace(struct trace *tr)
+{
+    fclose(tr->fp);
+}
+
+/* reads a LEB128 varint. returns 0 at EOF */
+static int read_varint(FILE *fp, unsigned long long *x)
+{
+    int c, shift = 0;
+    *x = 0;
+    do {
+        if ((c = getc(fp)) == EOF)
+            return 0;
+        *x |= (unsigned long long)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 1;
+}
+
+static void write_varint(FILE *fp, unsigned long long x)
+{
+    while (x >= 0x80){
+        putc((x & 0x7f) | 0x80, fp);
+        x >>= 7;
+    }
+    putc(x, fp);
+}
+
+/* reads one binary record */
+static int read_record(FILE *fp, struct access *a)
+{
+    unsigned long long x;
+    int tag = getc(fp);
+    if (tag == EOF || (tag & 3) == 3 || !read_varint(fp, &a->addr))
+        return 0;
+    a->op = ops[tag & 3];
+    a->size = tag >> 3;
+    a->tid = 0;
+    if (a->size == 31){
+        if (!read_varint(fp, &x))
+            return 0;
+        a->size = x;
+    }
+    if (tag & 4){
+        if (!read_varint(fp, &x))
+            return 0;
+        a->tid = x;
+    }
+    return 1;
+}
+
+/* reads lines until a data access is found */
+int read_access(struct trace *tr, struct access *a)
+{
+    char tracebuf[LEN];
+    if (tr->binary)
+        return read_record(tr->fp, a);
+    while (fgets(tracebuf, LEN, tr->fp) != NULL) {
+        /* do nothing on instruction load */
+        if (tracebuf[0] == 'I')
+            continue;
+        if (tracebuf[1] != 'L' && tracebuf[1] != 'S' && tracebuf[1] != 'M')
+            continue;
+        a->op = tracebuf[1];
+        a->size = 0;
+        a->tid = 0;
+        /* extract the address, then size and thread tag if present */
+        if (sscanf(tracebuf + 2, "%llx,%d,%d", &a->addr, &a->size, &a->tid) < 1)
+            continue;
+        return 1;
+    }
+    return 0;
+}
+
+void put_magic(FILE *fp)
+{
+    fwrite(TRACE_MAGIC, 1, 8, fp);
+}
+
+void put_access(FILE *fp, const struct access *a, int binary)
+{
+    int size = a->size < 31 ? a->size : 31;
+    if (!binary){
+        if (a->tid)
+            fprintf(fp, " %c %llx,%d,%d\n", a->op, a->addr, a->size, a->tid);
+        else
+            fprintf(fp, " %c %llx,%d\n", a->op, a->addr, a->size);
+        return;
+    }
+    putc((strchr(ops, a->op) - ops) | (a->tid ? 4 : 0) | size << 3, fp);
+    write_varint(fp, a->addr);
+    if (size == 31)
+        write_varint(fp, a->size);
+    if (a->tid)
+        write_varint(fp, a->tid);
+}
@@ -0,0 +1,60 @@
+/*
+ * trace.h - reader and writer for memory traces, shared by csim and
+ * the trace tools.
+ *
+ * text traces use the valgrind lackey format. a data access line looks
+ * like " L 7ff0005c8,8". an optional third field tags the access with
+ * the thread that issued it:
+ *     " S 601040,4,3"
+ * untagged accesses belong to thread 0. instruction loads ("I ...")
+ * and any other noise in the trace are skipped.
+ *
+ * binary traces start with the 8 byte magic TRACE_MAGIC, followed by
+ * one record per access:
+ *     tag byte: bits 0-1 op (0 L, 1 S, 2 M), bit 2 thread tag present,
+ *               bits 3-7 size, 31 meaning the size follows as varint
+ *     address as LEB128 varint
+ *     [size as varint] [thread tag as varint]
+ * records are self contained, so a binary trace can be resumed from
+ * any record offset like a text one.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+#define TRACE_MAGIC "CSTRACE1"
+
+/* one data access read from a trace */
+struct access{
+/* 'L' load, 'S' store or 'M' modify */
+    char op;
+/* accessed address and number of bytes */
+    unsigned long long addr;
+    int size;
+/* thread tag, 0 when absent */
+    int tid;
+};
+
+/* an open trace file */
+struct trace{
+    FILE *fp;
+    char binary;
+};
+
+/* opens a text or binary trace for reading. returns 0, or -1 on error */
+int open_trace(struct trace *tr, const char *name);
+
+/* reads the next data access. returns 1 on success, 0 at EOF */
+int read_access(struct trace *tr, struct access *a);
+
+void close_trace(struct trace *tr);
+
+/* writes the binary magic, needed once before binary records */
+void put_magic(FILE *fp);
+
+/* appends one access to fp, as a binary record or a lackey line */
+void put_access(FILE *fp, const struct access *a, int binary);
+
+#endif /* TRACE_H */
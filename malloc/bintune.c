@@ -0,0 +1,338 @@
+/*
+ * bintune.c - fit the large group boundaries of mm.c to traces.
+ *
+ * for block sizes from 136 bytes up to the mapping threshold, reads
+ * from every trace how often each size is requested, and how many
+ * blocks of each size are live, averaged over the trace. a request
+ * searches the treap of its group, which holds about as many free
+ * blocks as the group has live ones, in about log2 steps. the search
+ * of mm.c is best fit whatever the groups are, so they only set this
+ * cost. the N_LBLK groups of least cost, with every trace weighted
+ * equally, are found by dynamic programming over candidate boundaries
+ * and written as a header for mm.c built with -DMM_BINS.
+ *
+ * prints the expected steps per large request of each trace with the
+ * default groups and the fitted ones.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+
+/* as in mm.c */
+#define LBLK_FL_MIN 7
+#define LBLK_SL_SHIFT 2
+#define LBLK_FL 10
+#define N_LBLK (LBLK_FL << LBLK_SL_SHIFT)
+#define ALIGN(size) (((size) + 7) & ~0x7)
+
+/* candidate boundaries the groups are chosen from, at most */
+#define MAX_CAND 512
+
+/* smallest block of a large group */
+#define LBLK_MIN 136
+
+/* histograms of one trace, 8 bytes per bucket, as prefix sums */
+struct trace{
+    const char *name;
+    double *req;        /* requests of each size, summing to 1 */
+    double *live;       /* blocks of each size live, on average */
+    double nreq;        /* large requests */
+};
+
+/* global vars */
+long map_threshold = 128 * 1024;
+const char *out = "mm-bins.h";
+int nbucket;
+struct trace *traces;
+int ntrace;
+
+void usage(char *argv[]){
+    printf("Usage: %s [-h] [-m <bytes>] [-o <file>] <trace>...\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -m <bytes> Requests this large are mapped (default 131072).\n");
+    printf("  -o <file>  Write the boundaries to file (default mm-bins.h).\n");
+}
+
+/* parse command-line options using get-opt */
+void get_input(int argc, char *argv[]){
+    int optc = 0;
+    while((optc = getopt(argc, argv, "m:o:h")) != -1){
+        switch (optc) {
+            case 'm':
+                map_threshold = atol(optarg);
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+    if (optind == argc || map_threshold <= LBLK_MIN){
+        usage(argv);
+        exit(1);
+    }
+}
+
+/* default large group boundary, LBLK_SZ of mm.c */
+unsigned int default_sz(int idx){
+    int fl = (idx >> LBLK_SL_SHIFT) + LBLK_FL_MIN;
+    return (1u << fl) +
+        ((unsigned int)(idx & ((1 << LBLK_SL_SHIFT) - 1)) << (fl - LBLK_SL_SHIFT));
+}
+
+/* bucket of a block size, nbucket for sizes beyond the histograms */
+int bucket(unsigned long sz){
+    return sz / 8 < (unsigned long)nbucket ? (int)(sz / 8) : nbucket;
+}
+
+/* block size of a request of size bytes, 0 if it is not large */
+unsigned long blk_of(long size){
+    unsigned long blk = ALIGN(size + 4);
+    return blk >= LBLK_MIN && size < map_threshold ? blk : 0;
+}
+
+/* read one trace into t */
+void read_trace(struct trace *t, const char *name){
+    FILE *fp;
+    char type[8];
+    int weight, nids, nops, ignore, id, i, b;
+    long size = 0, align;
+    unsigned long *blk;
+    double *cnt, *last, now = 0;
+    if ((fp = fopen(name, "r")) == NULL){
+        perror(name);
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &weight, &nids, &nops, &ignore) != 4){
+        fprintf(stderr, "%s: bad header\n", name);
+        exit(1);
+    }
+    t->name = name;
+    t->req = calloc(nbucket + 1, sizeof(double));
+    t->live = calloc(nbucket + 1, sizeof(double));
+    blk = calloc(nids, sizeof(unsigned long));
+    cnt = calloc(nbucket, sizeof(double));
+    last = calloc(nbucket, sizeof(double));
+    /* a block of size sz comes (n = 1) or goes (n = -1) */
+#define LIVE(sz, n) do{ \
+        if ((sz) && (b = bucket(sz)) < nbucket){ \
+            t->live[b] += cnt[b] * (now - last[b]); \
+            last[b] = now; \
+            cnt[b] += (n); \
+        } \
+    }while (0)
+    while (fscanf(fp, "%7s", type) == 1){
+        now++;
+        switch (type[0]){
+            case 'a':
+            case 'm':
+            case 'r':
+                /* a missing size repeats the last one, as in mdriver */
+                if (fscanf(fp, "%d", &id) != 1 || id < 0 || id >= nids){
+                    fprintf(stderr, "%s: bad request %ld\n", name, (long)now);
+                    exit(1);
+                }
+                if (fscanf(fp, "%ld", &size) == 1 && type[0] == 'm')
+                    fscanf(fp, "%ld", &align);
+                LIVE(blk[id], -1);
+                if ((blk[id] = blk_of(size)) != 0){
+                    t->req[bucket(blk[id])]++;
+                    t->nreq++;
+                }
+                LIVE(blk[id], 1);
+                break;
+            case 'f':
+                if (fscanf(fp, "%d", &id) != 1){
+                    fprintf(stderr, "%s: bad free %ld\n", name, (long)now);
+                    exit(1);
+                }
+                /* f -1 frees NULL */
+                if (id < 0 || id >= nids)
+                    break;
+                LIVE(blk[id], -1);
+                blk[id] = 0;
+                break;
+            default:
+                fprintf(stderr, "%s: bad type %s\n", name, type);
+                exit(1);
+        }
+    }
+#undef LIVE
+    for (i = 0; i < nbucket; i++)
+        t->live[i] = (t->live[i] + cnt[i] * (now - last[i])) / (now ? now : 1);
+    /* prefix sums, requests scaled to one per trace */
+    for (i = nbucket; i > 0; i--){
+        t->req[i] = t->req[i - 1] / (t->nreq ? t->nreq : 1);
+        t->live[i] = t->live[i - 1];
+    }
+    t->req[0] = t->live[0] = 0;
+    for (i = 1; i <= nbucket; i++){
+        t->req[i] += t->req[i - 1];
+        t->live[i] += t->live[i - 1];
+    }
+    fclose(fp);
+    free(blk);
+    free(cnt);
+    free(last);
+}
+
+/* expected steps per large request of trace t within the group of
+ * buckets [lo, hi) */
+double group_cost(const struct trace *t, int lo, int hi){
+    lo = lo < nbucket ? lo : nbucket;
+    hi = hi < nbucket ? hi : nbucket;
+    return (t->req[hi] - t->req[lo]) * log2(1 + t->live[hi] - t->live[lo]);
+}
+
+/* expected steps per large request of trace t with boundaries sz */
+double trace_cost(const struct trace *t, const unsigned int *sz){
+    double c = 0;
+    int i;
+    for (i = 0; i < N_LBLK; i++)
+        c += group_cost(t, bucket(sz[i]),
+                i + 1 < N_LBLK ? bucket(sz[i + 1]) : nbucket);
+    return c;
+}
+
+int cmp_uint(const void *a, const void *b){
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* candidate boundaries: the N_LBLK default ones and the sizes at which
+ * the requests of all traces pass each 1 / (MAX_CAND - N_LBLK) of their
+ * total. at most MAX_CAND, sorted, without duplicates */
+int candidates(unsigned int *cand){
+    double all, step, next;
+    int n = 0, i, j, k;
+    for (i = 0; i < N_LBLK; i++)
+        cand[n++] = default_sz(i);
+    all = 0;
+    for (j = 0; j < ntrace; j++)
+        all += traces[j].req[nbucket];
+    step = all / (MAX_CAND - N_LBLK);
+    next = step;
+    for (i = 1; i <= nbucket && n < MAX_CAND; i++){
+        double sum = 0;
+        for (j = 0; j < ntrace; j++)
+            sum += traces[j].req[i];
+        /* the size of bucket i - 1 takes the total past next */
+        if (sum >= next){
+            cand[n++] = (i - 1) * 8;
+            while (next <= sum)
+                next += step;
+        }
+    }
+    qsort(cand, n, sizeof(unsigned int), cmp_uint);
+    for (i = k = 0; i < n; i++)
+        if (cand[i] >= default_sz(0) && (!k || cand[i] != cand[k - 1]))
+            cand[k++] = cand[i];
+    return k;
+}
+
+/* boundaries of least total cost over all traces into sz */
+void fit(unsigned int *sz){
+    static unsigned int cand[MAX_CAND + N_LBLK];
+    double *cost, *best;
+    int *from, n, g, i, j, t;
+    n = candidates(cand);
+    /* cost[i * (n + 1) + j]: one group from cand[i] to cand[j], the
+     * last candidate n standing for no end */
+    cost = malloc((size_t)(n + 1) * (n + 1) * sizeof(double));
+    for (i = 0; i < n; i++)
+        for (j = i + 1; j <= n; j++){
+            double c = 0;
+            for (t = 0; t < ntrace; t++)
+                c += group_cost(&traces[t], bucket(cand[i]),
+                        j < n ? bucket(cand[j]) : nbucket);
+            cost[i * (n + 1) + j] = c;
+        }
+    /* best[g * (n + 1) + j]: g groups covering cand[0] to cand[j] */
+    best = malloc((size_t)(N_LBLK + 1) * (n + 1) * sizeof(double));
+    from = malloc((size_t)(N_LBLK + 1) * (n + 1) * sizeof(int));
+    for (j = 0; j <= n; j++)
+        best[j] = j ? HUGE_VAL : 0;
+    for (g = 1; g <= N_LBLK; g++)
+        for (j = 0; j <= n; j++){
+            best[g * (n + 1) + j] = HUGE_VAL;
+            for (i = g - 1; i < j; i++){
+                double c = best[(g - 1) * (n + 1) + i] + cost[i * (n + 1) + j];
+                if (c < best[g * (n + 1) + j]){
+                    best[g * (n + 1) + j] = c;
+                    from[g * (n + 1) + j] = i;
+                }
+            }
+        }
+    for (g = N_LBLK, j = n; g > 0; g--){
+        j = from[g * (n + 1) + j];
+        sz[g - 1] = cand[j];
+    }
+    free(cost);
+    free(best);
+    free(from);
+}
+
+/* write the boundaries as a header */
+void write_bins(const unsigned int *sz, int argc, char *argv[]){
+    FILE *fp;
+    int i;
+    if ((fp = fopen(out, "w")) == NULL){
+        perror(out);
+        exit(1);
+    }
+    fprintf(fp, "/*\n * %s - large group boundaries of mm.c, used with "
+            "-DMM_BINS.\n *\n * generated by bintune -m %ld from", out,
+            map_threshold);
+    for (i = optind; i < argc; i++)
+        fprintf(fp, "%s%s", (i - optind) % 4 ? " " : "\n *     ", argv[i]);
+    fprintf(fp, "\n */\n\n/* smallest block of each large group */\n"
+            "#define LBLK_BINS %d\n"
+            "static const unsigned int lblk_min[LBLK_BINS] = {", N_LBLK);
+    for (i = 0; i < N_LBLK; i++)
+        fprintf(fp, "%s%u,", i % 8 ? " " : "\n    ", sz[i]);
+    fprintf(fp, "\n};\n\n/* smallest block of the last group */\n"
+            "#define LBLK_TOP %u\n", sz[N_LBLK - 1]);
+    fclose(fp);
+}
+
+/* main routine */
+int main(int argc, char *argv[])
+{
+    unsigned int def[N_LBLK], sz[N_LBLK];
+    double c0, c1, sum0 = 0, sum1 = 0;
+    int i;
+    get_input(argc, argv);
+    nbucket = (int)(ALIGN(map_threshold + 4) / 8);
+    ntrace = argc - optind;
+    traces = calloc(ntrace, sizeof(struct trace));
+    for (i = 0; i < ntrace; i++)
+        read_trace(&traces[i], argv[optind + i]);
+    for (i = 0; i < N_LBLK; i++)
+        def[i] = default_sz(i);
+    fit(sz);
+    write_bins(sz, argc, argv);
+
+    printf("%-32s %10s %10s %10s %8s\n", "trace", "requests",
+            "default", "fitted", "gain");
+    for (i = 0; i < ntrace; i++){
+        c0 = trace_cost(&traces[i], def);
+        c1 = trace_cost(&traces[i], sz);
+        sum0 += c0;
+        sum1 += c1;
+        printf("%-32s %10.0f %10.3f %10.3f %7.1f%%\n", traces[i].name,
+                traces[i].nreq, c0, c1, c0 > 0 ? 100 * (c0 - c1) / c0 : 0);
+    }
+    printf("%-32s %10s %10.3f %10.3f %7.1f%%\n", "(mean)", "",
+            sum0 / ntrace, sum1 / ntrace,
+            sum0 > 0 ? 100 * (sum0 - sum1) / sum0 : 0);
+    printf("boundaries written to %s\n", out);
+    return 0;
+}
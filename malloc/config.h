@@ -30,6 +30,7 @@
  */
 #define DEFAULT_TRACEFILES \
 	"alaska.rep", \
+	"align.rep", \
 	"amptjp.rep", \
     "bash.rep", \
 	"boat.rep",\
@@ -48,6 +49,7 @@
 	"ls.rep", \
 	"malloc.rep", \
 	"malloc-free.rep", \
+	"malloc0.rep", \
     "needle.rep", \
 	"nlydf.rep", \
 	"perl.rep", \
@@ -56,7 +58,8 @@
 	"rm.rep", \
 	"rulsr.rep",\
 	"seglist.rep", \
-	"short2.rep"
+	"short2.rep", \
+	"temps.rep"
 
 /*
  * If this is uncommented, then use "alt grading", in which
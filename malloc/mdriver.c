@@ -18,11 +18,13 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
 #include "driverlib.h"
 
@@ -44,6 +46,14 @@
 #define WUTIL 2
 #define WPERF 3
 
+/* runs of a trace when measuring the worst case cycles of a request */
+#define WORST_RUNS 5
+
+/* runs of a trace on each number of threads (-T), and slots of the
+   ring that hands blocks from one thread to the next */
+#define REPLAY_RUNS 3
+#define HANDOFF_LEN 1024
+
 /******************************
  * The key compound data types
  *****************************/
@@ -68,6 +78,7 @@ typedef struct {
 	enum { ALLOC, FREE, REALLOC } type; /* type of request */
 	int index;                        /* index for free() to use later */
 	size_t size;                      /* byte size of alloc/realloc request */
+	size_t align;                     /* alignment of alloc request, or 0 */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -93,6 +104,27 @@ typedef struct {
 	range_t *ranges;
 } speed_t;
 
+/*
+ * Carries blocks from one replay thread (-T) to the next, which frees
+ * them: a ring with one producer and one consumer.
+ */
+typedef struct {
+	char *slot[HANDOFF_LEN];
+	unsigned head;   /* slots filled, written by the producer */
+	unsigned tail;   /* slots emptied, written by the consumer */
+} handoff_t;
+
+/* One thread replaying its own copy of a trace (-T) */
+typedef struct {
+	trace_t *trace;
+	int use_libc;            /* replay with libc malloc */
+	char **blocks;           /* this copy's blocks, NULL once freed */
+	handoff_t *in, *out;     /* from the previous thread, to the next */
+	pthread_barrier_t *start;
+	int failed;              /* an allocation failed */
+	pthread_t tid;
+} replayer_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
 	/* set in read_trace */
@@ -106,6 +138,8 @@ typedef struct {
 
 	/* defined only for the student malloc package */
 	double util;     /* space utilization for this trace (always 0 for libc) */
+	double maxcyc[4];/* worst cycles of one malloc, free, realloc, and of
+	                    one request that resized the heap (-w) */
 
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -138,6 +172,15 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* measure the worst case cycles of single requests (-w) */
+static int worst_flag = 0;
+
+/* where the allocator statistics of each trace go (-S), or NULL */
+static FILE *stats_fp = NULL;
+
+/* most threads replaying a trace at once (-T), or 0 */
+static int threads = 0;
+
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -180,9 +223,21 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_worst(trace_t *trace, stats_t *stats);
+
+/* Replay copies of a trace on several threads, with mm or libc */
+static void run_threaded(int num_tracefiles, const char *tracedir,
+		char **tracefiles, int run_libc);
+static double eval_threads(trace_t *trace, int nthreads, int use_libc);
+static void *replay_thread(void *ptr);
+
+/* Allocate for an alloc request, with or without an alignment */
+static void *mm_alloc_op(const traceop_t *op);
+static void *libc_alloc_op(const traceop_t *op);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printworst(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 	__attribute__((format(printf, 3,4)));
@@ -236,11 +291,21 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 			if (verbose > 1)
 				printf("efficiency, ");
 			mm_stats[i].util = eval_mm_util(trace, i);
+#ifdef MM_STATS
+			if (stats_fp) {
+				fprintf(stats_fp, "%s{\"trace\": \"%s\", \"stats\": ",
+						i ? ",\n " : "", trace->filename);
+				mm_stats_dump(stats_fp);
+				fprintf(stats_fp, "}");
+			}
+#endif
 			speed_params->trace = trace;
 			speed_params->ranges = ranges;
 			if (verbose > 1)
 				printf("and performance.\n");
 			mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+			if (worst_flag)
+				eval_mm_worst(trace, &mm_stats[i]);
 		}
 
 		free_trace(trace);
@@ -280,7 +345,7 @@ int main(int argc, char **argv)
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDwS:T:")) != EOF) {
 		switch (c) {
 
 			case 'A': /* Hidden Autolab driver argument */
@@ -338,6 +403,26 @@ int main(int argc, char **argv)
 				set_timeout = atoi(optarg);
 				break;
 
+			case 'w': /* Measure worst case cycles per request */
+				worst_flag = 1;
+				break;
+
+			case 'S': /* Dump allocator statistics as JSON */
+#ifndef MM_STATS
+				app_error("-S needs an allocator built with MMOPTS=-DMM_STATS\n");
+#endif
+				if ((stats_fp = fopen(optarg, "w")) == NULL)
+					unix_error("ERROR: cannot open %s", optarg);
+				break;
+
+			case 'T': /* Replay each trace on up to n threads */
+#ifndef MM_THREADS
+				app_error("-T needs an allocator built with MMOPTS=-DMM_THREADS\n");
+#endif
+				if ((threads = atoi(optarg)) < 1 || threads > 64)
+					app_error("-T takes 1 to 64 threads\n");
+				break;
+
 			case 'h': /* Print this message */
 				usage();
 				exit(0);
@@ -413,8 +498,14 @@ int main(int argc, char **argv)
 	if (mm_stats == NULL)
 		unix_error("mm_stats calloc in main failed");
 
+	if (stats_fp)
+		fprintf(stats_fp, "[");
 	run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
 			ranges, &speed_params);
+	if (stats_fp) {
+		fprintf(stats_fp, "]\n");
+		fclose(stats_fp);
+	}
 
 
 	/* Display the mm results in a compact table */
@@ -430,9 +521,19 @@ int main(int argc, char **argv)
 			printf("\nResults for mm malloc:\n");
 			printresults(num_tracefiles, mm_stats);
 			printf("\n");
+			if (worst_flag) {
+				printworst(num_tracefiles, mm_stats);
+				printf("\n");
+			}
 		}
 	}
 
+	/* Optionally replay the traces on several threads at once */
+	if (threads && !onetime_flag) {
+		run_threaded(num_tracefiles, tracedir, tracefiles, run_libc);
+		printf("\n");
+	}
+
 	/*
 	 * Accumulate the aggregate statistics for the student's mm package
 	 */
@@ -575,11 +676,13 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must lie within the extent of the heap */
-	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+	/* The payload must lie within the extent of the heap, or within
+	   a region mapped by mem_map */
+	if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+			!mem_mapped_range(lo, hi)) {
 		malloc_error(trace, opnum,
-				"Payload (%p:%p) lies outside heap (%p:%p)",
+				"Payload (%p:%p) lies outside heap (%p:%p) and mapped regions",
 				lo, hi, mem_heap_lo(), mem_heap_hi());
 		return 0;
 	}
@@ -723,7 +826,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	FILE *tracefile;
 	trace_t *trace;
 	char type[MAXLINE];
-	int index, size;
+	int index, size, align;
 	int max_index = 0;
 	int op_index;
 
@@ -783,6 +886,18 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				trace->ops[op_index].type = ALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
+				max_index = (index > max_index) ? index : max_index;
+				break;
+			case 'm': /* m <id> <size> <align>: aligned alloc */
+				fscanf(tracefile, "%u %u %u", &index, &size, &align);
+				if (align & (align - 1))
+					app_error("%s: alignment %d is not a power of two",
+							trace->filename, align);
+				trace->ops[op_index].type = ALLOC;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = align;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'r':
@@ -844,6 +959,29 @@ static void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * mm_alloc_op - Call mm_malloc for an alloc request, or mm_memalign
+ *     if it carries an alignment
+ */
+static void *mm_alloc_op(const traceop_t *op)
+{
+	if (op->align)
+		return mm_memalign(op->align, op->size);
+	return mm_malloc(op->size);
+}
+
+/*
+ * libc_alloc_op - The same with the libc malloc package
+ */
+static void *libc_alloc_op(const traceop_t *op)
+{
+	void *p;
+
+	if (op->align)
+		return posix_memalign(&p, op->align, op->size) ? NULL : p;
+	return malloc(op->size);
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -890,18 +1028,28 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 
 			case ALLOC: /* mm_malloc */
 
-				/* Call the student's malloc */
-				if ((p = mm_malloc(size)) == NULL) {
+				/* Call the student's malloc, or memalign. NULL is a
+				 * valid answer to a request of size 0 */
+				if ((p = mm_alloc_op(&trace->ops[i])) == NULL && size != 0) {
 					malloc_error(trace, i, "mm_malloc failed.");
 					return 0;
 				}
 
+				/* Aligned requests must get their alignment */
+				if (trace->ops[i].align &&
+						((unsigned long)p & (trace->ops[i].align - 1))) {
+					malloc_error(trace, i, "Payload address (%p) not aligned "
+							"to %zu bytes", p, trace->ops[i].align);
+					return 0;
+				}
+
 				/*
 				 * Test the range of the new block for correctness and add it
 				 * to the range list if OK. The block must be  be aligned properly,
 				 * and must not overlap any currently allocated block.
+				 * A block of size 0 has no range to check.
 				 */
-				if (add_range(ranges, p, size, trace, i, index) == 0)
+				if (size > 0 && add_range(ranges, p, size, trace, i, index) == 0)
 					return 0;
 
 				/* Remember region */
@@ -980,10 +1128,10 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   high water mark of the heap in bytes while running the student's
+ *   malloc package on the trace. mem_sbrk() lets the package lower
+ *   the brk pointer again, so this is not always the final heap size.
+ *   Regions mapped with mem_map() count as heap.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -1011,7 +1159,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 				index = trace->ops[i].index;
 				size = trace->ops[i].size;
 
-				if ((p = mm_malloc(size)) == NULL) {
+				if ((p = mm_alloc_op(&trace->ops[i])) == NULL && size != 0) {
 					app_error("trace %d: mm_malloc failed in eval_mm_util",
 							tracenum);
 				}
@@ -1068,7 +1216,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
 	printf(".");
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -1078,7 +1226,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
+	int i, index, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 	reinit_trace(trace);
@@ -1094,8 +1242,8 @@ static void eval_mm_speed(void *ptr)
 
 			case ALLOC: /* mm_malloc */
 				index = trace->ops[i].index;
-				size = trace->ops[i].size;
-				if ((p = mm_malloc(size)) == NULL)
+				if ((p = mm_alloc_op(&trace->ops[i])) == NULL &&
+						trace->ops[i].size != 0)
 					app_error("mm_malloc error in eval_mm_speed");
 				trace->blocks[index] = p;
 				break;
@@ -1124,6 +1272,305 @@ static void eval_mm_speed(void *ptr)
 		}
 }
 
+/*
+ * eval_mm_worst - Measure the worst case cycles of a single mm_malloc,
+ *    mm_free and mm_realloc call. Every request is timed on its own
+ *    in WORST_RUNS runs of the trace and counted with its fastest run,
+ *    so that interrupts and the first touch of heap pages are not
+ *    charged to the allocator. The cost of reading the cycle counter
+ *    is subtracted. Requests that grow or shrink the heap, or map or
+ *    unmap a region, pay for a system call, and are counted apart.
+ */
+static void eval_mm_worst(trace_t *trace, stats_t *stats)
+{
+	int i, k, index;
+	double cyc, ovhd_cyc, *best;
+	char *p, *block, *resized;
+	size_t heapsize;
+
+	if ((best = malloc(trace->num_ops * sizeof(double))) == NULL ||
+			(resized = calloc(trace->num_ops, 1)) == NULL)
+		unix_error("malloc error in eval_mm_worst");
+	for (i = 0;  i < trace->num_ops;  i++)
+		best[i] = DBL_MAX;
+
+	ovhd_cyc = DBL_MAX;
+	for (i = 0;  i < 100;  i++) {
+		start_counter();
+		cyc = get_counter();
+		if (cyc < ovhd_cyc)
+			ovhd_cyc = cyc;
+	}
+
+	for (k = 0;  k < WORST_RUNS;  k++) {
+		reinit_trace(trace);
+		mem_reset_brk();
+		if (mm_init() < 0)
+			app_error("mm_init failed in eval_mm_worst");
+
+		for (i = 0;  i < trace->num_ops;  i++) {
+			index = trace->ops[i].index;
+			heapsize = mem_heapsize() + mem_mapsize();
+			switch (trace->ops[i].type) {
+
+				case ALLOC: /* mm_malloc */
+					start_counter();
+					p = mm_alloc_op(&trace->ops[i]);
+					cyc = get_counter();
+					if (p == NULL && trace->ops[i].size != 0)
+						app_error("mm_malloc error in eval_mm_worst");
+					trace->blocks[index] = p;
+					break;
+
+				case REALLOC: /* mm_realloc */
+					block = trace->blocks[index];
+					start_counter();
+					p = mm_realloc(block, trace->ops[i].size);
+					cyc = get_counter();
+					if (p == NULL && trace->ops[i].size != 0)
+						app_error("mm_realloc error in eval_mm_worst");
+					trace->blocks[index] = p;
+					break;
+
+				case FREE: /* mm_free */
+					block = index < 0 ? NULL : trace->blocks[index];
+					start_counter();
+					mm_free(block);
+					cyc = get_counter();
+					break;
+
+				default:
+					app_error("Nonexistent request type in eval_mm_worst");
+			}
+			if (cyc < best[i])
+				best[i] = cyc;
+			if (mem_heapsize() + mem_mapsize() != heapsize)
+				resized[i] = 1;
+		}
+	}
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+		cyc = best[i] > ovhd_cyc ? best[i] - ovhd_cyc : 0;
+		k = resized[i] ? 3 : trace->ops[i].type;
+		if (cyc > stats->maxcyc[k])
+			stats->maxcyc[k] = cyc;
+	}
+	free(best);
+	free(resized);
+}
+
+/*
+ * handoff_put - pass block p to the next thread, unless its ring is
+ *    full; return whether it was passed.
+ */
+static int handoff_put(handoff_t *h, char *p)
+{
+	unsigned head;
+
+	if (h == NULL)
+		return 0;
+	head = h->head;
+	if (head - __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE) == HANDOFF_LEN)
+		return 0;
+	h->slot[head % HANDOFF_LEN] = p;
+	__atomic_store_n(&h->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/*
+ * handoff_take - free the blocks the previous thread passed on.
+ */
+static void handoff_take(handoff_t *h, int use_libc)
+{
+	unsigned tail, head;
+
+	if (h == NULL)
+		return;
+	tail = h->tail;
+	head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+	if (tail == head)
+		return;
+	for (; tail != head; tail++) {
+		if (use_libc)
+			free(h->slot[tail % HANDOFF_LEN]);
+		else
+			mm_free(h->slot[tail % HANDOFF_LEN]);
+	}
+	__atomic_store_n(&h->tail, tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * replay_thread - replay one copy of the trace. blocks with an odd
+ *    index are freed by the next thread: they go out through a
+ *    handoff ring, and the blocks coming in are freed between
+ *    requests.
+ */
+static void *replay_thread(void *ptr)
+{
+	replayer_t *r = (replayer_t *)ptr;
+	trace_t *trace = r->trace;
+	traceop_t *op;
+	char *p;
+	int i;
+
+	pthread_barrier_wait(r->start);
+	for (i = 0;  i < trace->num_ops;  i++) {
+		op = &trace->ops[i];
+		handoff_take(r->in, r->use_libc);
+		switch (op->type) {
+			case ALLOC: /* malloc */
+				p = r->use_libc ? libc_alloc_op(op) : mm_alloc_op(op);
+				if (p == NULL && op->size != 0) {
+					r->failed = 1;
+					return NULL;
+				}
+				r->blocks[op->index] = p;
+				break;
+
+			case REALLOC: /* realloc */
+				p = r->blocks[op->index];
+				p = r->use_libc ? realloc(p, op->size) : mm_realloc(p, op->size);
+				if (p == NULL && op->size != 0) {
+					r->failed = 1;
+					return NULL;
+				}
+				r->blocks[op->index] = p;
+				break;
+
+			case FREE: /* free, here or by the next thread */
+				if (op->index < 0)
+					break;
+				p = r->blocks[op->index];
+				r->blocks[op->index] = NULL;
+				if (p == NULL || !(op->index & 1) || !handoff_put(r->out, p)) {
+					if (r->use_libc)
+						free(p);
+					else
+						mm_free(p);
+				}
+				break;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * eval_threads - seconds for nthreads threads to replay a copy of the
+ *    trace each, with mm or libc malloc, or -1 if an allocation failed.
+ */
+static double eval_threads(trace_t *trace, int nthreads, int use_libc)
+{
+	replayer_t *r;
+	handoff_t *rings;
+	pthread_barrier_t start;
+	struct timespec t0, t1;
+	int i, j, failed = 0;
+
+	if ((r = calloc(nthreads, sizeof(replayer_t))) == NULL ||
+			(rings = calloc(nthreads, sizeof(handoff_t))) == NULL)
+		unix_error("calloc failed in eval_threads");
+	if (!use_libc) {
+		mem_reset_brk();
+		if (mm_init() < 0)
+			app_error("mm_init failed in eval_threads");
+	}
+	pthread_barrier_init(&start, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++) {
+		r[i].trace = trace;
+		r[i].use_libc = use_libc;
+		r[i].start = &start;
+		if ((r[i].blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+			unix_error("calloc failed in eval_threads");
+		if (nthreads > 1) {
+			r[i].out = &rings[i];
+			r[i].in = &rings[(i + nthreads - 1) % nthreads];
+		}
+		if (pthread_create(&r[i].tid, NULL, replay_thread, &r[i]))
+			unix_error("pthread_create failed in eval_threads");
+	}
+	/* every thread waits at the barrier: they start as main does */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pthread_barrier_wait(&start);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(r[i].tid, NULL);
+	for (i = 0; i < nthreads; i++)
+		if (nthreads > 1)
+			handoff_take(&rings[i], use_libc);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	/* the mm heap starts over, but libc keeps what is left */
+	for (i = 0; i < nthreads; i++) {
+		failed |= r[i].failed;
+		if (use_libc)
+			for (j = 0; j < trace->num_ids; j++)
+				free(r[i].blocks[j]);
+		free(r[i].blocks);
+	}
+	pthread_barrier_destroy(&start);
+	free(rings);
+	free(r);
+	if (failed)
+		return -1;
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+/*
+ * run_threaded - replay each trace on 1, 2, 4 ... threads threads at
+ *    once and print the throughput over all threads, for mm and, with
+ *    -l, libc malloc.
+ */
+static void run_threaded(int num_tracefiles, const char *tracedir,
+		char **tracefiles, int run_libc)
+{
+	int i, k, n, lib, run, ncounts = 0, counts[8];
+	double secs, best, ops[2][8] = {{0}}, sum[2][8] = {{0}};
+	stats_t stats;
+	trace_t *trace;
+
+	for (n = 1; n < threads; n *= 2)
+		counts[ncounts++] = n;
+	counts[ncounts++] = threads;
+
+	printf("Replay on several threads (Kops over all threads, best of %d;\n"
+			"odd blocks are freed by the next thread):\n", REPLAY_RUNS);
+	printf("%8s", "threads");
+	for (k = 0; k < ncounts; k++)
+		printf("%10d", counts[k]);
+	printf("  trace\n");
+	for (i = 0; i < num_tracefiles; i++) {
+		mem_init();
+		trace = read_trace(&stats, tracedir, tracefiles[i]);
+		for (lib = 0; lib <= run_libc; lib++) {
+			printf("%8s", lib ? "libc" : "mm");
+			for (k = 0; k < ncounts; k++) {
+				best = -1;
+				for (run = 0; run < REPLAY_RUNS; run++) {
+					if ((secs = eval_threads(trace, counts[k], lib)) < 0)
+						break;
+					if (best < 0 || secs < best)
+						best = secs;
+				}
+				if (best <= 0) {
+					printf("%10s", "--");
+					continue;
+				}
+				printf("%10.0f", counts[k] * trace->num_ops / best / 1e3);
+				ops[lib][k] += counts[k] * trace->num_ops;
+				sum[lib][k] += best;
+			}
+			printf("  %s\n", trace->filename);
+		}
+		free_trace(trace);
+		mem_deinit();
+	}
+	for (lib = 0; lib <= run_libc; lib++) {
+		printf("%8s", lib ? "libc" : "mm");
+		for (k = 0; k < ncounts; k++)
+			printf("%10.0f", sum[lib][k] > 0 ? ops[lib][k] / sum[lib][k] / 1e3 : 0);
+		printf("  (all)\n");
+	}
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1141,7 +1588,7 @@ static int eval_libc_valid(trace_t *trace)
 		switch (trace->ops[i].type) {
 
 			case ALLOC: /* malloc */
-				if ((p = malloc(trace->ops[i].size)) == NULL) {
+				if ((p = libc_alloc_op(&trace->ops[i])) == NULL) {
 					malloc_error(trace, i, "libc malloc failed");
 					unix_error("System message");
 				}
@@ -1182,7 +1629,7 @@ static int eval_libc_valid(trace_t *trace)
 static void eval_libc_speed(void *ptr)
 {
 	int i;
-	int index, size, newsize;
+	int index, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -1192,8 +1639,7 @@ static void eval_libc_speed(void *ptr)
 		switch (trace->ops[i].type) {
 			case ALLOC: /* malloc */
 				index = trace->ops[i].index;
-				size = trace->ops[i].size;
-				if ((p = malloc(size)) == NULL)
+				if ((p = libc_alloc_op(&trace->ops[i])) == NULL)
 					unix_error("malloc failed in eval_libc_speed");
 				trace->blocks[index] = p;
 				break;
@@ -1373,12 +1819,39 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 	va_end(ap);
 }
 
+/*
+ * printworst - prints the worst case cycles of a single request of
+ *    each kind, for every trace and over all traces (-w)
+ */
+static void printworst(int n, stats_t *stats)
+{
+	int i, k;
+	double all[4] = {0, 0, 0, 0};
+
+	printf("Worst case cycles of a single request (sbrk: any request "
+			"that resized the heap or a mapping):\n");
+	printf("%10s%10s%10s%10s  %s\n", "malloc", "free", "realloc", "sbrk",
+			"trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("%10.0f%10.0f%10.0f%10.0f  %s\n", stats[i].maxcyc[ALLOC],
+				stats[i].maxcyc[FREE], stats[i].maxcyc[REALLOC],
+				stats[i].maxcyc[3], stats[i].filename);
+		for (k = 0; k < 4; k++)
+			if (stats[i].maxcyc[k] > all[k])
+				all[k] = stats[i].maxcyc[k];
+	}
+	printf("%10.0f%10.0f%10.0f%10.0f  %s\n", all[ALLOC], all[FREE],
+			all[REALLOC], all[3], "(all)");
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+	fprintf(stderr, "Usage: mdriver [-hlVdDw] [-f <file>] [-S <file>] [-T <n>]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
 	fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1390,4 +1863,7 @@ static void usage(void)
 	fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
 	fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-w         Report worst case cycles of single requests.\n");
+	fprintf(stderr, "\t-S <file>  Write allocator statistics of each trace to <file> as JSON.\n");
+	fprintf(stderr, "\t-T <n>     Also replay each trace on 1, 2, 4 ... n threads at once.\n");
 }
@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE				/* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -20,6 +21,24 @@
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static char *mem_zero;			/* heap from here on reads as zeros */
+static size_t mem_mapped;		/* bytes in mapped regions */
+static size_t mem_peak;			/* largest heap plus mapped regions */
+
+/* regions mapped apart from the heap */
+#define MAX_MAPS 4096
+static struct {
+	char *addr;
+	size_t len;
+} maps[MAX_MAPS];
+static int nmaps;
+
+static void update_peak(void) {
+	size_t size = mem_heapsize() + mem_mapped;
+
+	if (size > mem_peak)
+		mem_peak = size;
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -34,6 +53,10 @@ void mem_init(void){
 			0);						/* offset (dunno) */
 	mem_max_addr = heap + MAX_HEAP;
 	mem_brk = heap;					/* heap is empty initially */
+	mem_zero = heap;
+	mem_mapped = 0;
+	mem_peak = 0;
+	nmaps = 0;
 }
 
 /* 
@@ -44,22 +67,47 @@ void mem_deinit(void){
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *		and unmap the regions the allocator left mapped
  */
 void mem_reset_brk(){
 	mem_brk = heap;
+	while (nmaps > 0)
+		mem_unmap(maps[0].addr, maps[0].len);
+	mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area.
+ *		A negative incr shrinks the heap, and the pages above the new
+ *		brk are given back to the system.
  */
 void *mem_sbrk(int incr) {
 	char *old_brk = mem_brk;
 
+	if (incr < 0) {
+		size_t pg = mem_pagesize();
+		char *top;
+
+		if (mem_brk + incr < heap) {
+			errno = EINVAL;
+			fprintf(stderr, "ERROR: mem_sbrk failed. Heap shrunk below its start\n");
+			return (void *)-1;
+		}
+		/* no sbrk() here: libc malloc may have moved the real brk since */
+		mem_brk += incr;
+		/* also release what earlier heaps left above the old brk */
+		top = (char *)(((unsigned long)mem_zero + pg - 1) & ~(pg - 1));
+		mem_release(mem_brk, top - mem_brk);
+		top = (char *)(((unsigned long)mem_brk + pg - 1) & ~(pg - 1));
+		if (top < mem_zero)
+			mem_zero = top;
+		return (void *)old_brk;
+	}
+
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
+	if (((mem_brk + incr) > mem_max_addr) ||
             sbrk(incr) == (void *) -1) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
@@ -67,9 +115,105 @@ void *mem_sbrk(int incr) {
 	}
 
 	mem_brk += incr;
+	if (mem_brk > mem_zero)
+		mem_zero = mem_brk;
+	update_peak();
 	return (void *)old_brk;
 }
 
+/*
+ * mem_release - give the whole pages within [addr, addr + len) back to
+ *		the system. They read as zeros when next touched. Used for the
+ *		heap above a lowered brk, and by the allocator for large free
+ *		blocks inside the heap.
+ */
+void mem_release(void *addr, size_t len) {
+	size_t pg = mem_pagesize();
+	char *lo = (char *)(((unsigned long)addr + pg - 1) & ~(pg - 1));
+	char *hi = (char *)(((unsigned long)addr + len) & ~(pg - 1));
+
+	if (lo < hi)
+		madvise(lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_map - map a region of len bytes (a multiple of the page size)
+ *		apart from the heap, for allocations too large to share it.
+ *		The region reads as zeros. Returns NULL on failure.
+ */
+void *mem_map(size_t len) {
+	char *p;
+
+	if (nmaps == MAX_MAPS)
+		return NULL;
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	maps[nmaps].addr = p;
+	maps[nmaps].len = len;
+	nmaps++;
+	mem_mapped += len;
+	update_peak();
+	return (void *)p;
+}
+
+/*
+ * mem_remap - resize a region returned by mem_map to len bytes, moving
+ *		it if needed. The contents are kept. Returns NULL on failure,
+ *		and the old region is then left as it was.
+ */
+void *mem_remap(void *addr, size_t old_len, size_t len) {
+	char *p;
+	int i;
+
+	for (i = 0; i < nmaps && maps[i].addr != addr; i++)
+		;
+	assert(i < nmaps && maps[i].len == old_len);
+	p = mremap(addr, old_len, len, MREMAP_MAYMOVE);
+	if (p == MAP_FAILED)
+		return NULL;
+	maps[i].addr = p;
+	maps[i].len = len;
+	mem_mapped += len - old_len;
+	update_peak();
+	return (void *)p;
+}
+
+/*
+ * mem_unmap - unmap a region returned by mem_map
+ */
+void mem_unmap(void *addr, size_t len) {
+	int i;
+
+	for (i = 0; i < nmaps && maps[i].addr != addr; i++)
+		;
+	assert(i < nmaps && maps[i].len == len);
+	munmap(addr, len);
+	maps[i] = maps[--nmaps];
+	mem_mapped -= len;
+}
+
+/*
+ * mem_mapped_range - returns 1 if [lo, hi] lies within one mapped region
+ */
+int mem_mapped_range(void *lo, void *hi) {
+	int i;
+
+	for (i = 0; i < nmaps; i++)
+		if ((char *)lo >= maps[i].addr &&
+				(char *)hi < maps[i].addr + maps[i].len)
+			return 1;
+	return 0;
+}
+
+/*
+ * mem_mapsize() - returns the bytes in mapped regions
+ */
+size_t mem_mapsize() {
+	return mem_mapped;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +228,16 @@ void *mem_heap_hi(){
 	return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_heap_zero - return the lowest address from which the heap area
+ *		is known to read as zeros: it was never handed out by mem_sbrk,
+ *		or given back since. The heap below the brk is zero from here
+ *		on until the caller writes to it.
+ */
+void *mem_heap_zero(){
+	return (void *)mem_zero;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
@@ -91,6 +245,14 @@ size_t mem_heapsize() {
 	return (size_t)((void *)mem_brk - (void *)heap);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *		the heap was last reset, mapped regions included
+ */
+size_t mem_peak_heapsize() {
+	return mem_peak;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
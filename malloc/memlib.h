@@ -6,6 +6,14 @@ void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_zero(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+void mem_release(void *addr, size_t len);
+void *mem_map(size_t len);
+void *mem_remap(void *addr, size_t old_len, size_t len);
+void mem_unmap(void *addr, size_t len);
+int mem_mapped_range(void *lo, void *hi);
+size_t mem_mapsize(void);
 size_t mem_pagesize(void);
 
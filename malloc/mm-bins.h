@@ -0,0 +1,35 @@
+/*
+ * mm-bins.h - large group boundaries of mm.c, used with -DMM_BINS.
+ *
+ * generated by bintune -m 131072 from
+ *     traces/alaska.rep traces/align.rep traces/amptjp-bal.rep traces/amptjp.rep
+ *     traces/bash.rep traces/binary-bal.rep traces/binary.rep traces/binary2-bal.rep
+ *     traces/binary2.rep traces/boat.rep traces/cccp-bal.rep traces/cccp.rep
+ *     traces/chrome.rep traces/coalesce-big.rep traces/coalescing-bal.rep traces/coalescing.rep
+ *     traces/corners.rep traces/cp-decl-bal.rep traces/cp-decl.rep traces/exhaust.rep
+ *     traces/expr-bal.rep traces/expr.rep traces/firefox-reddit.rep traces/firefox-reddit2.rep
+ *     traces/firefox.rep traces/freeciv.rep traces/fs.rep traces/hostname.rep
+ *     traces/login.rep traces/lrucd.rep traces/ls.1.rep traces/ls.rep
+ *     traces/malloc-free.rep traces/malloc.rep traces/malloc0.rep traces/merry-go-round.rep
+ *     traces/mutt.rep traces/needle.rep traces/nlydf.rep traces/perl.1.rep
+ *     traces/perl.2.rep traces/perl.3.rep traces/perl.rep traces/pulseaudio.rep
+ *     traces/qyqyc.rep traces/random-bal.rep traces/random.rep traces/random2-bal.rep
+ *     traces/random2.rep traces/realloc-bal.rep traces/realloc.rep traces/realloc2-bal.rep
+ *     traces/realloc2.rep traces/rm.1.rep traces/rm.rep traces/rulsr.rep
+ *     traces/seglist.rep traces/short1-bal.rep traces/short1.rep traces/short2-bal.rep
+ *     traces/short2.rep traces/stty.rep traces/temps.rep traces/tty.rep
+ *     traces/xterm.rep
+ */
+
+/* smallest block of each large group */
+#define LBLK_BINS 40
+static const unsigned int lblk_min[LBLK_BINS] = {
+    128, 144, 152, 168, 184, 208, 224, 256,
+    272, 312, 368, 384, 408, 464, 512, 576,
+    680, 808, 896, 1016, 1160, 1272, 1536, 1816,
+    2128, 2560, 2936, 3568, 4080, 5120, 8192, 10776,
+    13016, 14928, 17408, 20008, 22536, 25152, 27752, 30336,
+};
+
+/* smallest block of the last group */
+#define LBLK_TOP 30336
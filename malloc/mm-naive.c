@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -35,6 +36,9 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
 #endif /* def DRIVER */
 
 /* single word (4) or double word (8) alignment */
@@ -124,6 +128,38 @@ void *realloc(void *oldptr, size_t size)
   return newptr;
 }
 
+/*
+ * memalign - Pad the brk pointer so that the next block is aligned.
+ */
+void *memalign(size_t align, size_t size)
+{
+  unsigned long brk = (unsigned long)mem_heap_hi() + 1;
+  size_t pad = (align - ((brk + SIZE_T_SIZE) & (align - 1))) & (align - 1);
+
+  if (align & (align - 1))
+    return NULL;
+  if (align > ALIGNMENT && pad && (long)mem_sbrk(pad) < 0)
+    return NULL;
+  return malloc(size);
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+  return memalign(align, size);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+  void *p;
+
+  if ((align & (align - 1)) || align < sizeof(void*))
+    return EINVAL;
+  if ((p = memalign(align, size)) == NULL)
+    return ENOMEM;
+  *memptr = p;
+  return 0;
+}
+
 /*
  * calloc - Allocate the block and set it to zero.
  */
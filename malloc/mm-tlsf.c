@@ -0,0 +1,507 @@
+/*
+ * mm-tlsf.c - malloc using two-level segregated fit (TLSF).
+ *
+ * build with "make MM=mm-tlsf" instead of the segregated first fit of
+ * mm.c. every malloc and free takes a bounded number of steps, no
+ * matter how many free blocks there are: no list is ever searched.
+ *
+ * headers and footers are like this:
+ *    31                    3  2  1  0
+ *   -----------------------------------
+ *  | s  s  s  s  ... s  s  s  0 a/f a/f
+ *   -----------------------------------
+ * bit 0 marks current block allocated
+ * bit 1 marks previous block allocated
+ * size here is the size of the whole block, a multiple of 8.
+ *
+ * blocks are like this:
+ *        |<------payload------>|
+ *  ------|-----|-----|....----|------
+ *  header| next| prev         |footer
+ *  ------|-----|-----|....----|------
+ *  4bytes 4bytes 4bytes        4bytes
+ *
+ * only free blocks have a footer, and the next/prev links, which are
+ * 32 bit offsets from the start of the heap (0 is the end of a list).
+ *
+ * free blocks are put into classes by their size: 2^SL_SHIFT classes
+ * for every power of two (first level), splitting it in equal steps
+ * (second level). sizes below SMALL_SZ all share first level 0, in
+ * steps of 8, so each small class holds one size only:
+ *      {16} {24} ... {120} | {128..135} ... {248..255} | {256..271} ...
+ * a bitmap of non-empty first levels, and one of non-empty classes for
+ * each first level, find the class to allocate from with two ctz.
+ *
+ * good fit: malloc rounds the request up to the next class boundary,
+ * so the first block of any class found is large enough. before the
+ * heap is extended, the first block of the class of the request itself
+ * is tried as well. free coalesces with both neighbours at once.
+ *
+ * the heap starts with the class heads and bitmaps, and ends with an
+ * allocated epilogue header of size 0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
+#endif /* def DRIVER */
+
+/* double word (8) alignment */
+#define ALIGNMENT 8
+
+/* rounds UP to the nearest multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+
+/* minimum block: header, two links and footer */
+#define MIN_BLK_SZ 16
+
+/* 2^SL_SHIFT classes per first level */
+#define SL_SHIFT 4
+#define SL_COUNT (1 << SL_SHIFT)
+
+/* sizes below SMALL_SZ are in first level 0, in steps of 8 */
+#define FL_SHIFT (SL_SHIFT + 3)
+#define SMALL_SZ (1u << FL_SHIFT)
+
+/* blocks are smaller than the heap, at most 2^HEAP_BITS bytes */
+#define HEAP_BITS 27
+#if MAX_HEAP > (1 << HEAP_BITS)
+#error "MAX_HEAP too large for the first level classes"
+#endif
+#define FL_COUNT (HEAP_BITS - FL_SHIFT + 1)
+
+#define ALLOC 1u
+#define PREV_ALLOC 2u
+
+/* dereference a pointer as uint* */
+#define EVAL4B(p) (*((unsigned int*)(p)))
+
+/* header, size and flags of a block */
+#define HEADER(p) (*(((unsigned int*)(p)) - 1))
+#define BLK_SZ(p) (HEADER(p) & ~7u)
+#define IS_ALLOC(p) (HEADER(p) & ALLOC)
+#define PREV_IS_ALLOC(p) (HEADER(p) & PREV_ALLOC)
+
+/* footer of a free block */
+#define FOOTER(p) EVAL4B((char*)(p) + BLK_SZ(p) - 8)
+
+/* next block in the heap, and the previous one if it is free */
+#define NEXT_BLK(p) ((char*)(p) + BLK_SZ(p))
+#define PREV_BLK(p) ((char*)(p) - EVAL4B((char*)(p) - 8))
+
+/* links of a free block, as offsets from heap_lo */
+#define L_NEXT(p) (((unsigned int*)(p))[0])
+#define L_PREV(p) (((unsigned int*)(p))[1])
+#define OFF(p) ((unsigned int)((char*)(p) - heap_lo))
+#define PTR(off) ((void*)(heap_lo + (off)))
+
+/* class heads and bitmaps, at the start of the heap */
+struct control {
+    unsigned int fl_map;
+    unsigned int sl_map[FL_COUNT];
+    unsigned int head[FL_COUNT][SL_COUNT];
+};
+
+static char *heap_lo;
+static struct control *ctl;
+
+/* payload address of the epilogue */
+#define EPILOGUE() ((char*)mem_heap_hi() + 1)
+
+/* class of a block size */
+static inline void mapping(unsigned int sz, int *fl, int *sl){
+    int b;
+    if (sz < SMALL_SZ){
+        *fl = 0;
+        *sl = sz >> 3;
+        return;
+    }
+    b = 31 - __builtin_clz(sz);
+    *fl = b - FL_SHIFT + 1;
+    *sl = (sz >> (b - SL_SHIFT)) & (SL_COUNT - 1);
+}
+
+/* class whose every block is at least sz: round sz up to the start of
+ * the next class, unless it starts one */
+static inline void mapping_up(unsigned int sz, int *fl, int *sl){
+    if (sz >= SMALL_SZ)
+        sz += (1u << (31 - __builtin_clz(sz) - SL_SHIFT)) - 1;
+    mapping(sz, fl, sl);
+}
+
+/* first block of the first non-empty class at or above fl, sl */
+static inline void *find_class(int *fl, int *sl){
+    unsigned int m;
+    if (*fl >= FL_COUNT)
+        return NULL;
+    m = ctl->sl_map[*fl] & (~0u << *sl);
+    if (!m){
+        m = ctl->fl_map & (~0u << *fl << 1);
+        if (!m)
+            return NULL;
+        *fl = __builtin_ctz(m);
+        m = ctl->sl_map[*fl];
+    }
+    *sl = __builtin_ctz(m);
+    return PTR(ctl->head[*fl][*sl]);
+}
+
+/* put a free block at the front of its class */
+static inline void insert_blk(void *blk){
+    int fl, sl;
+    unsigned int next;
+    mapping(BLK_SZ(blk), &fl, &sl);
+    next = ctl->head[fl][sl];
+    L_NEXT(blk) = next;
+    L_PREV(blk) = 0;
+    if (next)
+        L_PREV(PTR(next)) = OFF(blk);
+    ctl->head[fl][sl] = OFF(blk);
+    ctl->sl_map[fl] |= 1u << sl;
+    ctl->fl_map |= 1u << fl;
+}
+
+/* take a free block out of its class */
+static inline void remove_blk(void *blk){
+    int fl, sl;
+    unsigned int next = L_NEXT(blk), prev = L_PREV(blk);
+    if (next)
+        L_PREV(PTR(next)) = prev;
+    if (prev)
+        L_NEXT(PTR(prev)) = next;
+    else {
+        mapping(BLK_SZ(blk), &fl, &sl);
+        if ((ctl->head[fl][sl] = next) == 0){
+            ctl->sl_map[fl] &= ~(1u << sl);
+            if (!ctl->sl_map[fl])
+                ctl->fl_map &= ~(1u << fl);
+        }
+    }
+}
+
+/* make blk a free block of size sz, keeping its prev-alloc bit, and
+ * tell the next block */
+static inline void set_free(void *blk, unsigned int sz){
+    HEADER(blk) = sz | PREV_IS_ALLOC(blk);
+    FOOTER(blk) = sz;
+    HEADER(NEXT_BLK(blk)) &= ~PREV_ALLOC;
+}
+
+/* allocate the first asz bytes of the unlisted block blk, and free the
+ * rest if it can make a block, merged with a free next block */
+static void *place(void *blk, unsigned int asz){
+    unsigned int sz = BLK_SZ(blk);
+    char *rest, *next;
+    if (sz - asz >= MIN_BLK_SZ){
+        HEADER(blk) = asz | PREV_IS_ALLOC(blk) | ALLOC;
+        rest = (char*)blk + asz;
+        next = rest + (sz - asz);
+        if (!IS_ALLOC(next)){
+            remove_blk(next);
+            sz += BLK_SZ(next);
+        }
+        HEADER(rest) = PREV_ALLOC;
+        set_free(rest, sz - asz);
+        insert_blk(rest);
+    }
+    else {
+        HEADER(blk) |= ALLOC;
+        HEADER(NEXT_BLK(blk)) |= PREV_ALLOC;
+    }
+    return blk;
+}
+
+/* grow the heap so that a free block of asz bytes ends at the top, and
+ * return it unlisted. a free block in front of the epilogue is grown
+ * instead of starting a new one. */
+static void *extend(unsigned int asz){
+    char *blk = EPILOGUE();
+    unsigned int have = 0;
+    if (!PREV_IS_ALLOC(blk)){
+        blk = PREV_BLK(blk);
+        have = BLK_SZ(blk);
+        remove_blk(blk);
+    }
+    if (mem_sbrk(asz - have) == (void*)-1)
+        return NULL;
+    set_free(blk, asz);
+    HEADER(NEXT_BLK(blk)) = ALLOC;
+    return blk;
+}
+
+/*
+ * mm_init - initialize the malloc package.
+ * the class heads, then an empty heap: just the epilogue.
+ */
+int mm_init(void)
+{
+    /* the first header follows the control block, 4 bytes before an
+     * aligned payload */
+    unsigned int len = ALIGN(sizeof(struct control)) + 8;
+    if ((heap_lo = mem_sbrk(len)) == (void*)-1)
+        return -1;
+    ctl = (struct control*)heap_lo;
+    memset(ctl, 0, sizeof(struct control));
+    HEADER(EPILOGUE()) = ALLOC | PREV_ALLOC;
+    return 0;
+}
+
+/*
+ * malloc - take the first block of the smallest class that is sure to
+ * fit, else the first block of the request's own class if it fits, else
+ * grow the heap.
+ */
+void *malloc(size_t size)
+{
+    unsigned int asz;
+    int fl, sl;
+    void *blk;
+    if (size == 0 || size >= (1u << HEAP_BITS) - 8)
+        return NULL;
+    asz = ALIGN(size + 4);
+    if (asz < MIN_BLK_SZ)
+        asz = MIN_BLK_SZ;
+
+    mapping_up(asz, &fl, &sl);
+    if ((blk = find_class(&fl, &sl)) == NULL){
+        mapping(asz, &fl, &sl);
+        blk = PTR(ctl->head[fl][sl]);
+        if (!ctl->head[fl][sl] || BLK_SZ(blk) < asz)
+            return (blk = extend(asz)) ? place(blk, asz) : NULL;
+    }
+    remove_blk(blk);
+    return place(blk, asz);
+}
+
+/*
+ * free - coalesce with free neighbours and put into the class of the
+ * result.
+ */
+void free(void *ptr)
+{
+    char *blk = ptr, *next;
+    unsigned int sz;
+    if (ptr == NULL)
+        return;
+    sz = BLK_SZ(blk);
+    next = NEXT_BLK(blk);
+    if (!IS_ALLOC(next)){
+        remove_blk(next);
+        sz += BLK_SZ(next);
+    }
+    if (!PREV_IS_ALLOC(blk)){
+        blk = PREV_BLK(blk);
+        remove_blk(blk);
+        sz += BLK_SZ(blk);
+    }
+    set_free(blk, sz);
+    insert_blk(blk);
+}
+
+/*
+ * realloc - shrink in place, grow into a free next block or at the top
+ * of the heap, else move.
+ */
+void *realloc(void *ptr, size_t size)
+{
+    char *oldptr = ptr, *next, *newptr;
+    unsigned int asz, sz;
+
+    if (size == 0){
+        free(oldptr);
+        return NULL;
+    }
+    if (oldptr == NULL)
+        return malloc(size);
+    if (size >= (1u << HEAP_BITS) - 8)
+        return NULL;
+
+    asz = ALIGN(size + 4);
+    if (asz < MIN_BLK_SZ)
+        asz = MIN_BLK_SZ;
+    sz = BLK_SZ(oldptr);
+    next = NEXT_BLK(oldptr);
+    if (!IS_ALLOC(next) && sz + BLK_SZ(next) >= asz){
+        remove_blk(next);
+        sz += BLK_SZ(next);
+    }
+    else if (BLK_SZ(next) == 0 && sz < asz){
+        /* at the top: grow the heap by the difference */
+        if (mem_sbrk(asz - sz) == (void*)-1)
+            return NULL;
+        sz = asz;
+        HEADER(oldptr + sz) = ALLOC | PREV_ALLOC;
+    }
+    if (sz >= asz){
+        HEADER(oldptr) = sz | PREV_IS_ALLOC(oldptr);
+        return place(oldptr, asz);
+    }
+
+    if ((newptr = malloc(size)) == NULL)
+        return NULL;
+    memcpy(newptr, oldptr, BLK_SZ(oldptr) - 4);
+    free(oldptr);
+    return newptr;
+}
+
+/*
+ * memalign - malloc enough to align anyhow, free the fragment in front
+ * of the aligned block and split off the rest behind it.
+ */
+void *memalign(size_t align, size_t size)
+{
+    char *blk, *al;
+    unsigned int asz, gap;
+    if (align & (align - 1))
+        return NULL;
+    if (align <= ALIGNMENT)
+        return malloc(size);
+    if (size == 0 || align >= (1u << HEAP_BITS) - 8 - MIN_BLK_SZ ||
+            size >= (1u << HEAP_BITS) - 8 - MIN_BLK_SZ - align)
+        return NULL;
+    if ((blk = malloc(size + align + MIN_BLK_SZ)) == NULL)
+        return NULL;
+    al = blk;
+    if ((unsigned long)blk & (align - 1)){
+        al = (char*)(((unsigned long)blk + MIN_BLK_SZ + align - 1) & ~(align - 1));
+        gap = al - blk;
+        HEADER(al) = (BLK_SZ(blk) - gap) | PREV_ALLOC | ALLOC;
+        HEADER(blk) = gap | PREV_IS_ALLOC(blk) | ALLOC;
+        free(blk);
+    }
+    asz = ALIGN(size + 4);
+    if (asz < MIN_BLK_SZ)
+        asz = MIN_BLK_SZ;
+    return place(al, asz);
+}
+
+/* aligned_alloc - C11 name of memalign */
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+/* posix_memalign - memalign returning an error number */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *ptr;
+    if ((align & (align - 1)) || align < sizeof(void*))
+        return EINVAL;
+    /* malloc(0) is NULL here, so is a block of size 0 */
+    if ((ptr = memalign(align, size)) == NULL && size)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+/*
+ * calloc - Allocate the block and set it to zero.
+ */
+void *calloc (size_t nmemb, size_t size)
+{
+    size_t bytes = nmemb * size;
+    void *newptr;
+    if (nmemb && bytes / nmemb != size)
+        return NULL;
+    if ((newptr = malloc(bytes)) != NULL)
+        memset(newptr, 0, bytes);
+    return newptr;
+}
+
+/* print error and block info */
+static void make_error(void *blk){
+    if (blk)
+        printf("block %p: header %#x\n", blk, HEADER(blk));
+}
+
+/*
+ * mm_checkheap - walk the heap and all classes:
+ * headers aligned, footers of free blocks, no two free blocks next to
+ * each other, prev-alloc bits, bitmaps, links and classes of listed
+ * blocks, and every free block listed once.
+ */
+void mm_checkheap(int verbose)
+{
+    char *blk = heap_lo + ALIGN(sizeof(struct control)) + 8;
+    char *hi = EPILOGUE();
+    unsigned int prev_alloc = PREV_ALLOC, n_free = 0, n_listed = 0;
+    unsigned int off, prev;
+    int fl, sl, f, s;
+
+    for (; blk < hi; blk = NEXT_BLK(blk)){
+        if ((unsigned long)blk & 7 || BLK_SZ(blk) < MIN_BLK_SZ){
+            printf("bad block address or size\n");
+            make_error(blk);
+            return;
+        }
+        if (PREV_IS_ALLOC(blk) != prev_alloc){
+            printf("wrong prev-alloc bit\n");
+            make_error(blk);
+        }
+        if (!IS_ALLOC(blk)){
+            n_free++;
+            if (FOOTER(blk) != BLK_SZ(blk)){
+                printf("footer does not match header\n");
+                make_error(blk);
+            }
+            if (!prev_alloc){
+                printf("two free blocks next to each other\n");
+                make_error(blk);
+            }
+        }
+        if (verbose)
+            printf("%p: %u %s\n", blk, BLK_SZ(blk), IS_ALLOC(blk) ? "a" : "f");
+        prev_alloc = IS_ALLOC(blk) ? PREV_ALLOC : 0;
+    }
+    if (blk != hi || HEADER(hi) != (ALLOC | prev_alloc)){
+        printf("bad epilogue\n");
+        make_error(hi);
+    }
+
+    for (f = 0; f < FL_COUNT; f++){
+        if (!ctl->sl_map[f] != !(ctl->fl_map & (1u << f)))
+            printf("first level %d: wrong bitmap\n", f);
+        for (s = 0; s < SL_COUNT; s++){
+            if (!ctl->head[f][s] != !(ctl->sl_map[f] & (1u << s)))
+                printf("class %d.%d: wrong bitmap\n", f, s);
+            prev = 0;
+            for (off = ctl->head[f][s]; off; off = L_NEXT(blk)){
+                blk = PTR(off);
+                n_listed++;
+                if (blk < heap_lo || blk >= hi || IS_ALLOC(blk)){
+                    printf("class %d.%d: listed block not free\n", f, s);
+                    make_error(blk);
+                    return;
+                }
+                mapping(BLK_SZ(blk), &fl, &sl);
+                if (fl != f || sl != s){
+                    printf("class %d.%d: block in wrong class\n", f, s);
+                    make_error(blk);
+                }
+                if (L_PREV(blk) != prev){
+                    printf("class %d.%d: wrong prev link\n", f, s);
+                    make_error(blk);
+                }
+                prev = off;
+            }
+        }
+    }
+    if (n_free != n_listed)
+        printf("%u free blocks, %u listed\n", n_free, n_listed);
+}
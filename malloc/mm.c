@@ -11,6 +11,7 @@
  *   -----------------------------------
  * bit 0 marks current block
  * bit 1 of headers mark previous block
+ * bit 2 of allocated blocks marks a block grown by realloc
  * size here are multiples of 8 and does not include headers or footers.
  * 
  * blocks are like this:
@@ -22,7 +23,12 @@
  *        ^                    ^
  *    8 byte align         8 byte align
  *
- * NOTE that only large blocks use prev pointer.
+ * free blocks link with 32 bit offsets from the start of the heap
+ * (mem_heap_lo) instead of pointers, so a 16 byte block with 8 bytes of
+ * payload holds both links. 0 ends a list, as the heap starts with the
+ * arenas, not a block. list heads are offsets as well.
+ *        | next | prev |
+ *         4bytes 4bytes
  * 
  * free blocks are put into groups according to their size
  * (including header/footer):
@@ -31,24 +37,137 @@
  *      {16} {24} {32} {40} {48} {56} {64} {72} 
  *      {80} {88} {96} {104} {112} {120} {128}
  * 
- * second type: vary-sized large blocks
- *      {136,144...248,256} {264,272...504,512} {...768} {...1280} {...2048}
- *      {...3328} {...5376} {..8704} {..14080} {...22784} {...36864} {+} 
+ * second type: vary-sized large blocks, four groups for every power of
+ * two from 128 up (two-level segregation as in TLSF):
+ *      {136..152} {160..184} {192..216} {224..248} {256..312} {320..376}
+ *      ... {2^n + k*2^(n-2) ...} ... {+}
+ * the group of a size is found with one clz, see LBLK_IDX. with
+ * -DMM_BINS the groups start at the sizes in mm-bins.h instead, fitted
+ * to the traces by bintune, and are found in a table built by mm_init.
  *
- * first fit.
+ * a bitmap of non-empty small groups, and one bit per large group (N_LBLK),
+ * find the next group holding a block with one ctz each instead of
+ * scanning the list heads.
  *
+ * a small group is a list: its blocks all have the same size. a large
+ * group is a treap ordered by size, then address, with a priority
+ * hashed from the address, so that the smallest block that fits is
+ * found in O(log n): best fit within the group of the size, else the
+ * smallest block of the next non-empty group. of equal blocks, the
+ * lowest one is used.
+ *        | left | right |
+ *         4bytes 4bytes
+ * the children of a large free block take the places of next and prev.
  *
+ * arenas:
+ * the free lists belong to an arena. the heap is a sequence of chunks,
+ * each owned by one arena and fenced by its own prologue and epilogue:
+ *
+ *  ----|--------|----- blocks -----|--------|----
+ *  pad |prologue|                  |epilogue| pad
+ *  ----|--------|------------------|--------|----
+ *  4       8                            8     4
+ *
+ * an arena grows its last chunk in place while that chunk is at the top
+ * of the heap, otherwise it starts a new chunk. blocks never merge
+ * across chunks, so arenas are independent. without -DMM_THREADS there
+ * is a single arena and a single chunk.
+ *
+ * once a free leaves a free block of TRIM_THRESHOLD bytes or more
+ * (default 1MB), memory goes back to the system after RELEASE_DELAY
+ * more frees: if such a block ends the chunk at the top of the heap,
+ * the heap shrinks down to it, and the pages inside the other free
+ * blocks that large are released with mem_release, to come back
+ * zeroed when the block is used again. memory freed and soon taken
+ * again is not released and faulted in on every round.
+ *
+ * quick bins (build with -DMM_QUICK):
+ * freed small blocks (16..128 bytes) are not merged at once but pushed
+ * onto a quick bin of their exact size, staying marked allocated, and
+ * malloc takes a block of that size from its bin before any search.
+ * when no free block fits and the heap would grow, every quick bin is
+ * merged first, and the search runs again.
+ *
+ * huge blocks:
+ * requests of MMAP_THRESHOLD bytes or more (default 128KB) get a region
+ * of their own from mem_map, outside the heap, that free unmaps at once
+ * and realloc resizes with mem_remap. the region starts with its length,
+ * and the block's header has size 0, which no heap block has:
+ *
+ *  ------|-----|------|------ payload ...
+ *  length| pad |header|
+ *  ------|-----|------|------
+ *  8bytes 4     4
+ *
+ * slab mode (build with -DMM_SLAB):
+ * requests up to SLAB_MAX bytes (default 128) are rounded to a multiple
+ * of 8 and served from runs: aligned blocks of RUN_SZ bytes (default 1KB)
+ * holding objects of one size after a small run header. objects have
+ * no header of their own; a run keeps a bitmap of its free slots, and a
+ * free slot is found with ctz. a page map tells for every RUN_SZ page of
+ * the heap whether it is a run, so free finds the run of an object from
+ * its address alone. runs with free slots are kept on a list per size,
+ * and an empty run is given back to the heap unless it is the last one
+ * of its size. a size only gets runs after SLAB_WARM requests.
+ *
+ * lifetime mode (build with -DMM_LIFE):
+ * for every request size up to LIFE_MAX bytes (default 512), malloc
+ * predicts whether the object will die young from the ages of earlier
+ * objects of that size, counted in malloc and free calls. objects freed
+ * within LIFE_SHORT calls (default 1024) vote for a short life, older
+ * ones against. objects predicted short-lived are bump-allocated from a
+ * nursery: an aligned block of NURSERY_SZ bytes (default 4KB) found from
+ * the address by a map like the runs'. each object is preceded by the
+ * clock at its allocation and a header with its size. an empty nursery
+ * starts over; a full one is retired, voting against the sizes of the
+ * objects in it already older than LIFE_SHORT, and given back to the
+ * heap when its last object dies. nurseries only start once the heap
+ * holds LIFE_WARM of them.
+ * one request in LIFE_PROBE of the other sizes is a probe: it stays in
+ * the heap, where a long life costs nothing, and a small table hashed
+ * by its address keeps its birth until it is freed.
+ *
+ * thread-safe mode (build with -DMM_THREADS):
+ * there are MM_ARENAS arenas (default 4), each with its own lock.
+ * threads are bound to arenas round-robin, or by the cpu they first
+ * allocate on with -DMM_ARENA_CPU. heap growth is rounded to 64KB
+ * granules, and a map from granule to arena tells the owner of any
+ * block. a block freed by a thread of another arena is freed directly
+ * if the owner's lock is free, or pushed onto the owner's lock-free
+ * remote queue, which the owner drains on its next heap allocation.
+ * every thread also keeps a cache of small blocks (16..128 bytes, one
+ * list per small block group) that it serves without any locking. a
+ * cache is refilled from, and flushed back to, the arena in batches of
+ * TC_BATCH blocks, so the arena lock is taken once per batch. cached
+ * blocks stay marked allocated in the heap. with -DMM_SLAB the thread
+ * caches are not used, and runs belong to an arena like other blocks.
  *
  */
 
+#ifdef MM_ARENA_CPU
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#ifdef MM_ARENA_CPU
+#include <sched.h>
+#endif
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
+#ifdef MM_BINS
+#include "mm-bins.h"
+#endif
 
 
 /* If you want debugging output, use the following macro.  When you hand
@@ -68,6 +187,9 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
 #endif /* def DRIVER */
 
 /* double word (8) alignment */
@@ -85,23 +207,76 @@
 /* number of small block groups - 15 */
 #define N_SBLK 15
 
-/* number of large block groups - 9 */
-#define N_LBLK 12
+/* large block groups: 2^LBLK_SL_SHIFT groups per power of two from
+ * 2^LBLK_FL_MIN up, for LBLK_FL powers of two (the last group takes
+ * anything larger). they end near MMAP_THRESHOLD: larger free blocks
+ * only come from merging, and every head costs the arena header */
+#define LBLK_FL_MIN 7
+#define LBLK_SL_SHIFT 2
+#define LBLK_FL 10
+#define N_LBLK (LBLK_FL << LBLK_SL_SHIFT)
+#if N_LBLK > 64
+#error "the large groups must fit the 64 bit lrg_map"
+#endif
 
 /* initial heap: 512 bytes */
 #define INIT_SIZE (512)
 
+/* free space of TRIM_THRESHOLD bytes or more at the top of the heap is
+ * given back to the system; inside other free blocks this large, the
+ * whole pages are released. this happens RELEASE_DELAY frees after the
+ * first such block appears */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (1 << 20)
+#endif
+#ifndef RELEASE_DELAY
+#define RELEASE_DELAY 4096
+#endif
+
+/* depth of the treap walk of release_free; deeper blocks stay */
+#define RELEASE_STACK 64
+
+/* treap nodes memalign visits before it splits a larger block instead */
+#define ALIGN_PROBES 32
+
+/* requests this large are mapped apart from the heap */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (128 * 1024)
+#endif
+
+/* a chunk needs 24 bytes besides its blocks: pads, prologue, epilogue */
+#define CHUNK_OVERHEAD 24
+
 /* cast to void* pointer */
 #define VPTR(p) ((void*)(p))
 
 /* dereference a pointer as uint* */
 #define EVAL4B(p) (*((unsigned int*)(p)))
 
-/* dereference "next" pointer */
-#define L_NEXT(p) (*((void**)(p)))
+/* dereference "next" offset */
+#define L_NEXT(p) (*((unsigned int*)(p)))
+
+/* dereference "prev" offset */
+#define L_PREV(p) (*((unsigned int*)(p) + 1))
 
-/* dereference "prev" pointer */
-#define L_PREV(p) (*((void**)(p) + 1))
+/* children of a large free block in the treap of its group */
+#define T_LEFT(p) L_NEXT(p)
+#define T_RIGHT(p) L_PREV(p)
+
+/* treap priority of the block at offset off */
+#define T_PRIO(off) ((unsigned int)(off) * 2654435761u)
+
+/* block a comes before block b in a treap */
+#define T_BEFORE(a, b) (BLK_SZ(a) < BLK_SZ(b) || \
+        (BLK_SZ(a) == BLK_SZ(b) && (void*)(a) < (void*)(b)))
+
+/* heap offset of a block, and back (offset 0 is NULL) */
+#define BLK_OFF(p) ((unsigned int)((void*)(p) - heap_lo))
+#define OFF_BLK(off) ((off) ? heap_lo + (off) : NULL)
+
+#if MAX_HEAP > 0xffffffffu
+#error "MAX_HEAP too large for 32 bit list offsets"
+#endif
 
 /* dereference header */
 #define HEADER(p) (*(((unsigned int*)(p)) - 1))
@@ -118,142 +293,425 @@
 /* get size of a block (include header, footer) */
 #define BLK_SZ(p) ((HEADER(p) & ~7u) + 8)
 
+#ifdef MM_THREADS
+# ifndef MM_ARENAS
+#  define MM_ARENAS 4
+# endif
+/* heap growth is rounded to granules of 64KB, each owned by one arena */
+# define CHUNK_SHIFT 16
+# define CHUNK_UP(off) (((off) + (1ul << CHUNK_SHIFT) - 1) & \
+        ~((1ul << CHUNK_SHIFT) - 1))
+#else
+# undef MM_ARENAS
+# define MM_ARENAS 1
+# define CHUNK_UP(off) (off)
+#endif /* def MM_THREADS */
+
+#ifdef MM_SLAB
+# ifndef SLAB_MAX
+#  define SLAB_MAX 128
+# endif
+/* number of object sizes: 8, 16, ... SLAB_MAX */
+# define N_SLAB (SLAB_MAX >> 3)
+
+/* runs are aligned blocks of RUN_SZ bytes, the pages of the page map */
+# ifndef RUN_SHIFT
+#  define RUN_SHIFT 10
+# endif
+# define RUN_SZ (1 << RUN_SHIFT)
 
-/* elements of smlblkl_p (small blocks list's pointer) are headers of single
+/* kinds of pages in the page map */
+# define PG_HEAP 0
+# define PG_SLAB 1
+
+/* run holding an object */
+# define RUN_OF(p) ((struct run*)((unsigned long)(p) & ~(RUN_SZ - 1ul)))
+
+/* a page is a run; mapped blocks lie outside the page map */
+# define IS_SLAB(p) ((unsigned long)((void*)(p) - heap_lo) < MAX_HEAP && \
+        pagemap[(unsigned long)((void*)(p) - heap_lo) >> RUN_SHIFT] == PG_SLAB)
+
+/* header of a run, followed by its objects */
+struct run{
+/* runs of the same size with free slots */
+    struct run *next, *prev;
+    unsigned short cls_sz;
+    unsigned short nobj;
+    unsigned short nfree;
+/* bit set for every free slot */
+    unsigned long long map[RUN_SZ / 8 / 64];
+};
+
+/* offset of the first object in a run */
+# define RUN_START ALIGN(sizeof(struct run))
+
+/* a size gets runs only after this many requests, so that programs
+ * using a few small objects do not pay for a whole run */
+# ifndef SLAB_WARM
+#  define SLAB_WARM 32
+# endif
+#endif /* def MM_SLAB */
+
+#ifdef MM_LIFE
+# ifdef MM_THREADS
+#  error "-DMM_LIFE needs the single arena build"
+# endif
+/* nurseries are aligned blocks of NURSERY_SZ bytes (default 4KB) */
+# ifndef NURSERY_SHIFT
+#  define NURSERY_SHIFT 12
+# endif
+# define NURSERY_SZ (1 << NURSERY_SHIFT)
+
+/* requests up to LIFE_MAX bytes may go to a nursery */
+# ifndef LIFE_MAX
+#  define LIFE_MAX 512
+# endif
+# define N_LIFE (LIFE_MAX >> 3)
+
+/* an object freed within LIFE_SHORT operations lived short */
+# ifndef LIFE_SHORT
+#  define LIFE_SHORT 1024
+# endif
+
+/* a size predicted to live long still sends one request in LIFE_PROBE
+ * to the nursery, so that its prediction can change */
+# ifndef LIFE_PROBE
+#  define LIFE_PROBE 64
+# endif
+
+/* nurseries start once the heap holds LIFE_WARM of them */
+# ifndef LIFE_WARM
+#  define LIFE_WARM 64
+# endif
+
+/* bounds of a prediction */
+# define LIFE_BOUND 8
+
+/* probes timed at once, a power of two */
+# define N_PROBE 64
+
+/* slot of the probe table for the object at heap offset off */
+# define PROBE_SLOT(off) (((unsigned int)(off) * 2654435761u) >> 26)
+
+/* nursery holding an object */
+# define NURSERY_OF(p) ((struct nursery*)((unsigned long)(p) & ~(NURSERY_SZ - 1ul)))
+
+/* an object lies in a nursery; mapped blocks lie outside the map */
+# define IS_NURSERY(p) ((unsigned long)((void*)(p) - heap_lo) < MAX_HEAP && \
+        nursery_map[(unsigned long)((void*)(p) - heap_lo) >> NURSERY_SHIFT])
+
+/* operation count when a nursery object was allocated */
+# define BIRTH(p) (*(((unsigned int*)(p)) - 2))
+
+/* header of a nursery, followed by its objects: each one is the time
+ * of its allocation, a header with its size, then its payload */
+struct nursery{
+/* objects not freed yet */
+    unsigned int live;
+/* offset of the free space that follows the objects */
+    unsigned int top;
+};
+
+/* a heap object of a size predicted to live long, being timed */
+struct life_probe{
+/* heap offset of the object, 0 for a free slot */
+    unsigned int off;
+/* clock at its allocation */
+    unsigned int birth;
+/* its request size in 8 bytes */
+    unsigned int cls;
+};
+#endif /* def MM_LIFE */
+
+#ifdef MM_STATS
+/* buckets of the search length histogram: 0, 1, 2..3, 4..7, ... */
+# define N_SEARCH 16
+
+/* classes of the statistics: the small groups, the large groups, then
+ * mapped blocks */
+# define N_STAT_CLS (N_SBLK + N_LBLK + 1)
+# define MAP_CLS (N_STAT_CLS - 1)
+
+/* counters since mm_init, dumped by mm_stats_dump */
+struct stats{
+    unsigned long nmalloc[N_STAT_CLS];
+    unsigned long nfree[N_STAT_CLS];
+    unsigned long nrealloc;
+/* treap nodes visited by each search of the large groups */
+    unsigned long search[N_SEARCH];
+    unsigned long splits, merges, extends, trims, releases;
+/* payload bytes in use, and their most */
+    unsigned long live, peak_live;
+};
+
+/* threads count with atomic adds */
+# ifdef MM_THREADS
+#  define STAT_ADD(x, n) __atomic_fetch_add(&stats.x, (n), __ATOMIC_RELAXED)
+# else
+#  define STAT_ADD(x, n) (stats.x += (n))
+# endif
+# define STAT(x) STAT_ADD(x, 1)
+# define SEARCHED(n) STAT(search[(n) ? 32 - __builtin_clz(n) < N_SEARCH ? \
+            32 - __builtin_clz(n) : N_SEARCH - 1 : 0])
+# define COUNTED(p) stat_alloc(p)
+# define RESIZED(p, old_sz) stat_resize(p, old_sz)
+# define STAT_FREE(p) stat_free(p)
+#else
+# define STAT_ADD(x, n)
+# define STAT(x)
+# define SEARCHED(n) ((void)(n))
+# define COUNTED(p) (p)
+# define RESIZED(p, old_sz) (p)
+# define STAT_FREE(p)
+#endif /* def MM_STATS */
+
+/* a block with a mapping of its own; slab objects have no header */
+#ifdef MM_SLAB
+# define IS_MAPPED(p) (!IS_SLAB(p) && PAYLD_SZ(p) == 0)
+#else
+# define IS_MAPPED(p) (PAYLD_SZ(p) == 0)
+#endif
+
+/* length of the mapping of a mapped block */
+#define MAP_LEN(p) (*(size_t*)((void*)(p) - 16))
+
+/* an independent heap: free lists and the end of its last chunk */
+struct arena{
+/* elements of smlblkl (small blocks list) are offsets of the heads of double
  * linked list of small fix-sized blocks, of size 16, 24, .... 128 
  */
-static void** smlblkl_p;
-
-/* elements of lrgblkl_p (small blocks list's pointer) are headers of double 
- * linked list of large vary-sized blocks, of size {~256}, ....{32768+}
+    unsigned int smlblkl[N_SBLK];
+/* elements of lrgblkl (large blocks list) are offsets of the roots of
+ * treaps of large vary-sized blocks, of size {136..152}, ....{+}
  */
-static void** lrgblkl_p;
+    unsigned int lrgblkl[N_LBLK];
+/* bit i set when smlblkl[i] is not empty */
+    unsigned int sml_map;
+/* bit i set when lrgblkl[i] is not empty */
+    unsigned long long lrg_map;
+/* epilogue of the arena's last chunk, NULL before its first chunk */
+    void *epilogue;
+/* frees left before release_free runs, 0 if no large free block waits */
+    unsigned int release_wait;
+#ifdef MM_QUICK
+/* offsets of freed small blocks not merged yet, one list per small
+ * block group; bit i of quick_map set when quick[i] is not empty */
+    unsigned int quick[N_SBLK];
+    unsigned int quick_map;
+#endif
+#ifdef MM_SLAB
+/* runs with free slots, one list per object size */
+    struct run *slab[N_SLAB];
+/* requests of each size served by the free lists so far */
+    unsigned int warm[N_SLAB];
+#endif
+#ifdef MM_LIFE
+/* the nursery taking new objects, NULL before the first */
+    struct nursery *nursery;
+/* requests so far, the clock of lifetimes */
+    unsigned int clock;
+#endif
+#ifdef MM_THREADS
+/* protects the free lists and chunks of the arena */
+    pthread_mutex_t lock;
+/* blocks freed by other threads, linked through their payload */
+    void *volatile remote;
+#endif
+};
+
+/* the arenas, stored at the start of the heap */
+static struct arena *arenas;
 
 /* memory start block*/
 static void *prologue;
 
-/* memory end block */
-static void *epilogue;
+/* start of the heap */
+static void *heap_lo;
+
+#ifdef MM_SLAB
+/* kind of every page of the heap */
+static unsigned char pagemap[MAX_HEAP >> RUN_SHIFT];
+#endif
+
+#ifdef MM_LIFE
+/* every NURSERY_SZ page of the heap that is a nursery */
+static unsigned char nursery_map[MAX_HEAP >> NURSERY_SHIFT];
+
+/* per request size in 8 bytes: above 0 predicts a short life. the
+ * tables of lifetime mode are kept off the heap */
+static signed char life_pred[N_LIFE + 1];
+
+/* requests per size, to pick the probes */
+static unsigned char life_cnt[N_LIFE + 1];
+
+/* the probes being timed */
+static struct life_probe life_probes[N_PROBE];
+#endif
+
+#ifdef MM_STATS
+static struct stats stats;
+#endif
+
+#ifdef MM_THREADS
+/* blocks moved between a thread cache and the heap at once */
+#define TC_BATCH 16
+
+/* a thread caches at most this many blocks of each small size */
+#define TC_MAX 64
+
+/* cached blocks are linked through the first word of their payload */
+#define TC_NEXT(p) (*((void**)(p)))
+
+/* per-thread cache of small blocks, one list per small block group */
+struct tcache{
+    void *head[N_SBLK];
+    int cnt[N_SBLK];
+    /* arena the thread allocates from */
+    struct arena *ar;
+    /* generation of the heap the cached blocks belong to, 0 if unused */
+    unsigned int gen;
+};
+
+/* serialises mem_sbrk. taken after an arena lock, never before */
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* bumped by mm_init, so caches holding blocks of an old heap are dropped */
+static unsigned int heap_gen;
+
+/* next arena handed out round-robin */
+static unsigned int next_arena;
+
+/* the arena owning each granule of the heap */
+static unsigned char owner[MAX_HEAP >> CHUNK_SHIFT];
+
+static __thread struct tcache tc;
+
+/* flushes a thread's cache when the thread exits */
+static pthread_key_t tc_key;
+static pthread_once_t tc_once = PTHREAD_ONCE_INIT;
+
+# define LOCK(a) pthread_mutex_lock(&(a)->lock)
+# define UNLOCK(a) pthread_mutex_unlock(&(a)->lock)
+# define SBRK_LOCK() pthread_mutex_lock(&sbrk_lock)
+# define SBRK_UNLOCK() pthread_mutex_unlock(&sbrk_lock)
+
+/* arena owning a block */
+static inline struct arena *arena_of(void *blk){
+    return &arenas[owner[(unsigned long)(blk - heap_lo) >> CHUNK_SHIFT]];
+}
+
+/* hand the granules of [p, p + len) to arena a */
+static inline void set_owner(void *p, unsigned long len, struct arena *a){
+    memset(owner + ((unsigned long)(p - heap_lo) >> CHUNK_SHIFT),
+            (int)(a - arenas), len >> CHUNK_SHIFT);
+}
+#else
+# define LOCK(a)
+# define UNLOCK(a)
+# define SBRK_LOCK()
+# define SBRK_UNLOCK()
+#endif /* def MM_THREADS */
+
+#ifdef MM_BINS
+#if LBLK_BINS != N_LBLK
+#error "mm-bins.h was made for another number of large groups"
+#endif
 /* large block min size from index */
 inline static unsigned int LBLK_SZ(int idx){
-    switch(idx){
-        case 0: return 136;
-        case 1: return 264;
-        case 2: return 520;
-        case 3: return 776;
-        case 4: return 1288;
-        case 5: return 2056;
-        case 6: return 3336;
-        case 7: return 5384;
-        case 8: return 8712;
-        case 9: return 14088;
-        case 10: return 22792;
-        case 11: return 36872;
-        default: return 0; 
-    }
-}
-
-/* obtain index for large blocks */
-inline static int LBLK_IDX(int sz){
-    if (sz <= 256) return 0;
-    if (sz <= 512) return 1;
-    if (sz <= 768) return 2;
-    if (sz <= 1280) return 3;
-    if (sz <= 2048) return 4;
-    if (sz <= 3328) return 5;
-    if (sz <= 5376) return 6;
-    if (sz <= 8704) return 7;
-    if (sz <= 14080) return 8;
-    if (sz <= 22784) return 9;
-    if (sz <= 36864) return 10;
-    return 11;
-}
-/* 
- * mm_init - initialize the malloc package.
- * initialise list heads, all NULL except one large block almost INIT_SIZE
- * 
- */
-int mm_init(void)
-{
-    unsigned int i, sz;
-    void **p = (void**)mem_sbrk(INIT_SIZE);
-    /* initialise small block pointers to NULL */
-    smlblkl_p = p;
-    for (i = 0; i < N_SBLK; i++, p++)
-        *p = VPTR(NULL);
-    /* initialise large block pointers to NULL (except for the largest one) */
-    lrgblkl_p = p;
-    for (i = 0; i < N_LBLK; i++, p++)
-        *p = VPTR(NULL);
-    p++;
-    /* mark the start of all blocks */
-    HEADER(p) = 1u;
-    EVAL4B(p) = 1u;
-    prologue = p;
-    p++;
-    /* mark the end */
-    epilogue = VPTR(DOWN_ALIGN(mem_heap_hi() + 1));
-    /* make one large block */
-    sz = (unsigned int)(epilogue - VPTR(p) - 8);
-    HEADER(p) = sz | 2;
-    L_NEXT(p) = VPTR(NULL);
-    L_PREV(p) = VPTR(NULL);
-    EVAL4B(epilogue - 8) = sz;
-    sz += 8;
-    if (SBLK_IDX(sz) < N_SBLK)
-        smlblkl_p[SBLK_IDX(sz)] = p;
-    else
-        lrgblkl_p[LBLK_IDX(sz)] = p;
-    /* mark the end of all blocks */
-    if (mem_heap_hi() + 1 - epilogue < 4)
-        mem_sbrk((int)(4 + epilogue - mem_heap_hi() - 1));
-    HEADER(epilogue) = 1u;
-    EVAL4B(epilogue) = 1u;
-    return 0;
+    return lblk_min[idx];
 }
 
-/* for small blocks, always pick first block */
-void *find_sblk(int *idx){
-    int i;
-    for (i = *idx; i < N_SBLK; i++)
-        if (smlblkl_p[i] != NULL)
-            break;
-    if (i == N_SBLK)
-        return NULL;
-    *idx = i;
-    return smlblkl_p[i];
+/* group of each block size below the last group, by size / 8 */
+static unsigned char lblk_tab[LBLK_TOP >> 3];
+
+/* obtain index for large blocks: the last group starting at or below
+ * sz, sizes below the first group included */
+inline static int LBLK_IDX(unsigned int sz){
+    return sz < LBLK_TOP ? lblk_tab[sz >> 3] : N_LBLK - 1;
 }
 
-/* find a suitable large block */
-static void *find_lblk(unsigned int blk_sz, int *idx){
-    void* blk_p;
-    for (; *idx < N_LBLK; (*idx)++){
-        blk_p = lrgblkl_p[*idx];
-        while (blk_p != NULL){
-            if (BLK_SZ(blk_p) >= blk_sz)
-                return blk_p;
-            blk_p = L_NEXT(blk_p);
-        }
+/* fill lblk_tab from the boundaries */
+static void make_lblk_tab(void){
+    int i, idx = 0;
+    for (i = 0; i < LBLK_TOP >> 3; i++){
+        while (idx + 1 < N_LBLK && (unsigned int)i << 3 >= lblk_min[idx + 1])
+            idx++;
+        lblk_tab[i] = idx;
     }
-    return NULL;
+}
+#else
+/* large block min size from index */
+inline static unsigned int LBLK_SZ(int idx){
+    int fl = (idx >> LBLK_SL_SHIFT) + LBLK_FL_MIN;
+    return (1u << fl) +
+        ((unsigned int)(idx & ((1 << LBLK_SL_SHIFT) - 1)) << (fl - LBLK_SL_SHIFT));
+}
+
+/* obtain index for large blocks: the power of two of sz, and the next
+ * LBLK_SL_SHIFT bits below its top bit */
+inline static int LBLK_IDX(unsigned int sz){
+    int fl;
+    /* small sizes looking for a large block start at the first group */
+    if (sz < (1u << LBLK_FL_MIN))
+        return 0;
+    fl = 31 - __builtin_clz(sz);
+    int idx = ((fl - LBLK_FL_MIN) << LBLK_SL_SHIFT) |
+        ((sz >> (fl - LBLK_SL_SHIFT)) & ((1 << LBLK_SL_SHIFT) - 1));
+    return idx < N_LBLK ? idx : N_LBLK - 1;
+}
+#endif /* def MM_BINS */
+
+/* first non-empty small group at or above idx, N_SBLK if none */
+static inline int next_sgrp(struct arena *a, int idx){
+    unsigned int m = a->sml_map & (~0u << idx);
+    return m ? __builtin_ctz(m) : N_SBLK;
 }
 
-/* detach first element of list */
-static inline void detach_1st_sblk(int idx, void *blk){
-    smlblkl_p[idx] = L_NEXT(blk);
+/* first non-empty large group at or above idx, N_LBLK if none */
+static inline int next_lgrp(struct arena *a, int idx){
+    unsigned long long m;
+    if (idx >= N_LBLK)
+        return N_LBLK;
+    m = a->lrg_map & (~0ull << idx);
+    return m ? __builtin_ctzll(m) : N_LBLK;
 }
 
-/* detach a large block from list */
-static inline void detach_lblk(int idx, void *blk){
-    void *prev = L_PREV(blk);
-    void *next = L_NEXT(blk);
+/* detach a small block from list */
+static inline void detach_sblk(struct arena *a, int idx, void *blk){
+    unsigned int prev = L_PREV(blk);
+    unsigned int next = L_NEXT(blk);
     if (prev)
-        L_NEXT(prev) = next;
-    else
-        lrgblkl_p[idx] = next;
+        L_NEXT(OFF_BLK(prev)) = next;
+    else if ((a->smlblkl[idx] = next) == 0)
+        a->sml_map &= ~(1u << idx);
     if (next)
-        L_PREV(next) = prev;
+        L_PREV(OFF_BLK(next)) = prev;
+}
+
+/* detach a large block from the treap of its group: find it, then join
+ * its two subtrees in its place, the higher priority on top */
+static inline void detach_lblk(struct arena *a, int idx, void *blk){
+    unsigned int *slot = &a->lrgblkl[idx];
+    unsigned int off = BLK_OFF(blk);
+    unsigned int l = T_LEFT(blk), r = T_RIGHT(blk);
+    while (*slot != off)
+        slot = T_BEFORE(blk, OFF_BLK(*slot)) ?
+            &T_LEFT(OFF_BLK(*slot)) : &T_RIGHT(OFF_BLK(*slot));
+    while (l && r){
+        if (T_PRIO(l) > T_PRIO(r)){
+            *slot = l;
+            slot = &T_RIGHT(OFF_BLK(l));
+            l = *slot;
+        }
+        else {
+            *slot = r;
+            slot = &T_LEFT(OFF_BLK(r));
+            r = *slot;
+        }
+    }
+    *slot = l ? l : r;
+    if (!a->lrgblkl[idx])
+        a->lrg_map &= ~(1ull << idx);
 }
 
 /* rewrite header and footer */
@@ -273,19 +731,50 @@ static inline void *shorten(int blk_sz, void* blk){
 }
 
 /* attach a small block to front of the list */
-static inline void attach_sblk(int idx, void *blk){
-    L_NEXT(blk) = smlblkl_p[idx];
-    smlblkl_p[idx] = blk;
-}
-
-/* attach a large block to front of the list */
-static inline void attach_lblk(int idx, void *blk){
-    void *next = lrgblkl_p[idx];
-    lrgblkl_p[idx] = blk;
-    L_PREV(blk) = VPTR(NULL);
+static inline void attach_sblk(struct arena *a, int idx, void *blk){
+    unsigned int next = a->smlblkl[idx];
+    a->smlblkl[idx] = BLK_OFF(blk);
+    L_PREV(blk) = 0;
     L_NEXT(blk) = next;
     if (next)
-        L_PREV(next) = blk;
+        L_PREV(OFF_BLK(next)) = BLK_OFF(blk);
+    a->sml_map |= 1u << idx;
+}
+
+/* attach a large block to the treap of its group: go down while the
+ * blocks outrank it, then split the subtree there around it */
+static inline void attach_lblk(struct arena *a, int idx, void *blk){
+    unsigned int *slot = &a->lrgblkl[idx];
+    unsigned int off = BLK_OFF(blk), cur;
+    unsigned int *l = &T_LEFT(blk), *r = &T_RIGHT(blk);
+    if (!*slot)
+        a->lrg_map |= 1ull << idx;
+    while (*slot && T_PRIO(*slot) > T_PRIO(off))
+        slot = T_BEFORE(blk, OFF_BLK(*slot)) ?
+            &T_LEFT(OFF_BLK(*slot)) : &T_RIGHT(OFF_BLK(*slot));
+    for (cur = *slot; cur; ){
+        void *t = OFF_BLK(cur);
+        if (T_BEFORE(t, blk)){
+            *l = cur;
+            l = &T_RIGHT(t);
+            cur = T_RIGHT(t);
+        }
+        else {
+            *r = cur;
+            r = &T_LEFT(t);
+            cur = T_LEFT(t);
+        }
+    }
+    *l = *r = 0;
+    *slot = off;
+}
+
+/* attach a free block to the list of its size */
+static inline void attach_blk(struct arena *a, int blk_sz, void *blk){
+    if (SBLK_IDX(blk_sz) < N_SBLK)
+        attach_sblk(a, SBLK_IDX(blk_sz), blk);
+    else
+        attach_lblk(a, LBLK_IDX(blk_sz), blk);
 }
 
 /* mark a block as allocated */
@@ -304,28 +793,191 @@ static inline void mark_unused(void *blk){
     HEADER(blk + BLK_SZ(blk)) &= ~2;
 }
 
-/* find and detach a specific small block pointed by blk */
-static inline void find_del_sblk(int idx, void *blk){
-    void *ptr = smlblkl_p[idx];
-    if (ptr == blk){
-        detach_1st_sblk(idx, blk);
-        return;
+/* set up chunk [c, c + len) of arena a: prologue, epilogue and one free
+ * block in between, which is returned unattached */
+static void *make_chunk(struct arena *a, void *c, unsigned long len){
+    void *p = c + 8;
+    /* mark the start of all blocks */
+    HEADER(p) = 1u;
+    EVAL4B(p) = 1u;
+    /* mark the end */
+    a->epilogue = c + len - 8;
+    HEADER(a->epilogue) = 1u;
+    EVAL4B(a->epilogue) = 1u;
+    p += 8;
+    make_blk((int)(a->epilogue - p), p);
+    HEADER(p) |= 2;
+    return p;
+}
+
+/*
+ * mm_init - initialize the malloc package.
+ * initialise the arenas, all lists NULL except one large block almost
+ * INIT_SIZE in the first arena
+ *
+ */
+int mm_init(void)
+{
+    /* the arenas take their part of the initial heap */
+    unsigned long len = CHUNK_UP(MM_ARENAS * sizeof(struct arena) +
+            CHUNK_OVERHEAD + MIN_BLK_SZ > INIT_SIZE ?
+            MM_ARENAS * sizeof(struct arena) + CHUNK_OVERHEAD + MIN_BLK_SZ :
+            INIT_SIZE);
+    void *p = mem_sbrk(len);
+    int i;
+    if (p == (void*)-1)
+        return -1;
+    arenas = p;
+    heap_lo = p;
+    memset(arenas, 0, MM_ARENAS * sizeof(struct arena));
+#ifdef MM_SLAB
+    memset(pagemap, 0, sizeof(pagemap));
+#endif
+#ifdef MM_LIFE
+    memset(nursery_map, 0, sizeof(nursery_map));
+    memset(life_pred, 0, sizeof(life_pred));
+    memset(life_cnt, 0, sizeof(life_cnt));
+    memset(life_probes, 0, sizeof(life_probes));
+#endif
+#ifdef MM_STATS
+    memset(&stats, 0, sizeof(stats));
+#endif
+#ifdef MM_BINS
+    make_lblk_tab();
+#endif
+#ifdef MM_THREADS
+    heap_gen++;
+    memset(owner, 0, sizeof(owner));
+    for (i = 0; i < MM_ARENAS; i++)
+        pthread_mutex_init(&arenas[i].lock, NULL);
+#endif
+    /* the first chunk follows the arenas */
+    p = VPTR(ALIGN((unsigned long)(arenas + MM_ARENAS)));
+    prologue = p + 8;
+    p = make_chunk(&arenas[0], p, (unsigned long)(VPTR(arenas) + len - p));
+    i = BLK_SZ(p);
+    attach_blk(&arenas[0], i, p);
+    return 0;
+}
+
+/* for small blocks, always pick first block */
+void *find_sblk(struct arena *a, int *idx){
+    int i = next_sgrp(a, *idx);
+    if (i == N_SBLK)
+        return NULL;
+    *idx = i;
+    return OFF_BLK(a->smlblkl[i]);
+}
+
+/* find a suitable large block: the smallest one of at least blk_sz in
+ * the group of blk_sz, whose blocks may be too small, else the smallest
+ * one of a larger group */
+static void *find_lblk(struct arena *a, unsigned int blk_sz, int *idx){
+    void *blk_p = OFF_BLK(a->lrgblkl[*idx]), *best = NULL;
+    unsigned int steps = 0;
+    for (; blk_p != NULL; steps++){
+        if (BLK_SZ(blk_p) >= blk_sz){
+            best = blk_p;
+            blk_p = OFF_BLK(T_LEFT(blk_p));
+        }
+        else
+            blk_p = OFF_BLK(T_RIGHT(blk_p));
     }
-    /* iterate through list */
-    while (L_NEXT(ptr)){
-        if (L_NEXT(ptr) == blk){
-            L_NEXT(ptr) = L_NEXT(blk);
-            return;
+    if (!best && (*idx = next_lgrp(a, *idx + 1)) < N_LBLK)
+        for (best = OFF_BLK(a->lrgblkl[*idx]); T_LEFT(best); steps++)
+            best = OFF_BLK(T_LEFT(best));
+    SEARCHED(steps);
+    return best;
+}
+
+/* detach a free block from the list of its size */
+static inline void detach_blk(struct arena *a, int blk_sz, void *blk){
+    if (SBLK_IDX(blk_sz) < N_SBLK)
+        detach_sblk(a, SBLK_IDX(blk_sz), blk);
+    else
+        detach_lblk(a, LBLK_IDX(blk_sz), blk);
+}
+
+/*
+ * extend - get a block of blk_sz for arena a from new heap memory.
+ *     grows the arena's last chunk if it is at the top of the heap,
+ *     starts a new chunk otherwise. a free block at the end of a grown
+ *     chunk becomes the start of the new block.
+ */
+static void *extend(struct arena *a, int blk_sz)
+{
+    void *ptr, *brk;
+    unsigned long len;
+    int left, prev_alloc, last = 0;
+    SBRK_LOCK();
+    brk = mem_heap_hi() + 1;
+    if (a->epilogue && brk - a->epilogue <= 8){
+        if (!(HEADER(a->epilogue) & 2))
+            last = EVAL4B(a->epilogue - 8) + 8;
+        len = CHUNK_UP((unsigned long)(a->epilogue - last + blk_sz + 8 -
+                    mem_heap_lo()));
+        /* heap_realloc may find the free block at the top large enough */
+        if (len > (unsigned long)(brk - mem_heap_lo()))
+            len -= (unsigned long)(brk - mem_heap_lo());
+        else
+            len = 0;
+        if (mem_sbrk((int)len) == (void*)-1){
+            SBRK_UNLOCK();
+            return NULL;
+        }
+        ptr = a->epilogue - last;
+        if (last)
+            detach_blk(a, last, ptr);
+        prev_alloc = HEADER(ptr) & 2;
+        a->epilogue = brk + len - 8;
+        HEADER(a->epilogue) = 1u;
+        EVAL4B(a->epilogue) = 1u;
+        make_blk((int)(a->epilogue - ptr), ptr);
+        HEADER(ptr) |= prev_alloc;
+    }
+    else {
+        len = CHUNK_UP((unsigned long)(brk - mem_heap_lo()) + blk_sz +
+                CHUNK_OVERHEAD) - (unsigned long)(brk - mem_heap_lo());
+        if (mem_sbrk((int)len) == (void*)-1){
+            SBRK_UNLOCK();
+            return NULL;
         }
-        ptr = L_NEXT(ptr);
+        ptr = make_chunk(a, brk, len);
+    }
+#ifdef MM_THREADS
+    set_owner(brk, len, a);
+#endif
+    SBRK_UNLOCK();
+    STAT(extends);
+    /* rounding up may leave a free block behind the new one */
+    left = BLK_SZ(ptr) - blk_sz;
+    if (left >= MIN_BLK_SZ){
+        void *leftover = shorten(blk_sz, ptr);
+        make_blk(left, leftover);
+        attach_blk(a, left, leftover);
+        STAT(splits);
     }
+    mark_used(ptr);
+    return ptr;
 }
 
-/* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+#ifdef MM_SLAB
+static void *slab_alloc(struct arena *a, size_t size);
+static void slab_free(struct arena *a, void *ptr);
+#endif
+#ifdef MM_LIFE
+static void life_free(struct arena *a, void *ptr);
+#endif
+#ifdef MM_QUICK
+static void consolidate(struct arena *a);
+#endif
+
+/*
+ * heap_malloc - allocate a block from the free lists of arena a, or by
+ *     extending the heap. Always allocate a block whose size is a
+ *     multiple of the alignment.
  */
-void *malloc(size_t size)
+static void *heap_malloc(struct arena *a, size_t size)
 {
     /* make use of footer */
     int blk_sz = ALIGN(size + 4);
@@ -335,20 +987,31 @@ void *malloc(size_t size)
     int idx;
     int real_idx;
     int diff_sz;
-    int prev_alloc = 0;
+#ifdef MM_SLAB
+    if (size <= SLAB_MAX && (ptr = slab_alloc(a, size)) != NULL)
+        return ptr;
+#endif
     /* find small blk */
     if (blk_sz <= 128){
         idx = SBLK_IDX(blk_sz);
+#ifdef MM_QUICK
+        if ((ptr = OFF_BLK(a->quick[idx])) != NULL){
+            if (!(a->quick[idx] = L_NEXT(ptr)))
+                a->quick_map &= ~(1u << idx);
+            return ptr;
+        }
+#endif
         real_idx = idx;
-        ptr = find_sblk(&real_idx);
+        ptr = find_sblk(a, &real_idx);
         if (ptr){
-            detach_1st_sblk(real_idx, ptr);
+            detach_sblk(a, real_idx, ptr);
             /* split the blk */
             diff_sz = SBLK_SZ(real_idx - idx - 2);
             if (diff_sz >= MIN_BLK_SZ){
                 void *leftover = shorten(SBLK_SZ(idx), ptr);
                 make_blk(diff_sz, leftover);
-                attach_sblk(real_idx - idx - 2, leftover);
+                attach_sblk(a, real_idx - idx - 2, leftover);
+                STAT(splits);
             }
             mark_used(ptr);
             return ptr;
@@ -356,45 +1019,106 @@ void *malloc(size_t size)
     }
     /* find large blk */
     idx = LBLK_IDX(blk_sz);
-    ptr = find_lblk(blk_sz, &idx);
+    ptr = find_lblk(a, blk_sz, &idx);
     if (ptr){
-        detach_lblk(idx, ptr);
+        detach_lblk(a, idx, ptr);
         diff_sz = BLK_SZ(ptr) - blk_sz;
         if (diff_sz >= MIN_BLK_SZ){
             void *leftover = shorten(blk_sz, ptr);
             make_blk(diff_sz, leftover);
-            if (SBLK_IDX(diff_sz) < N_SBLK)
-                attach_sblk(SBLK_IDX(diff_sz), leftover);
-            else
-                attach_lblk(LBLK_IDX(diff_sz), leftover);
+            attach_blk(a, diff_sz, leftover);
+            STAT(splits);
         }
         mark_used(ptr);
         return ptr;
     }
+#ifdef MM_QUICK
+    /* merge the quick bins before growing the heap */
+    if (a->quick_map){
+        consolidate(a);
+        return heap_malloc(a, size);
+    }
+#endif
     /* increase heap */
-    prev_alloc = (HEADER(epilogue) & 2);
-    diff_sz = blk_sz + (int)(epilogue - mem_heap_hi()) - 1 + 8; 
-    if (mem_sbrk(diff_sz) == (void*)-1)
-        return NULL;
-    ptr = epilogue;
-    make_blk(blk_sz, ptr);
-    mark_used(ptr);
+    return extend(a, blk_sz);
+}
+
+/* shrink the heap so that it ends at the free block blk, the last one of
+ * arena a; returns 0 if another arena's chunk lies above */
+static int trim_top(struct arena *a, void *blk, int prev_alloc)
+{
+    unsigned long off, end;
+    SBRK_LOCK();
+    if (mem_heap_hi() + 1 - a->epilogue > 8){
+        SBRK_UNLOCK();
+        return 0;
+    }
+    /* the heap ends on a granule: a free block takes up the gap */
+    off = (unsigned long)(blk + 8 - mem_heap_lo());
+    end = CHUNK_UP(off);
+    if (end != off && end - off < MIN_BLK_SZ)
+        end = CHUNK_UP(off + MIN_BLK_SZ);
+    mem_sbrk(-(int)(mem_heap_hi() + 1 - mem_heap_lo() - end));
+    SBRK_UNLOCK();
+    STAT(trims);
+    a->epilogue = mem_heap_lo() + end - 8;
+    EVAL4B(a->epilogue) = 1u;
+    if (end == off){
+        HEADER(a->epilogue) = 1u | (prev_alloc ? 2 : 0);
+        return 1;
+    }
+    HEADER(a->epilogue) = 1u;
+    make_blk((int)(a->epilogue - blk), blk);
     if (prev_alloc)
-        HEADER(ptr) |= 2;
-    /* mark new end */
-    epilogue = ptr + blk_sz;
-    HEADER(epilogue) = 3u;
-    EVAL4B(epilogue) = 1u;
-    return ptr;
+        HEADER(blk) |= 2;
+    attach_blk(a, (int)(a->epilogue - blk), blk);
+    return 1;
 }
 
-/* mm_free - free a allocated pointer
- * always merge free space
+/* release_free - give the free blocks of TRIM_THRESHOLD bytes or more
+ * of arena a back: the one ending the top chunk shrinks the heap, the
+ * others keep only the pages of their header, links and footer
  */
-void free(void *ptr)
+static void release_free(struct arena *a)
+{
+    unsigned int stack[RELEASE_STACK];
+    void *blk;
+    int i, n, prev_alloc;
+    a->release_wait = 0;
+    /* the top first, so that its pages are not released in vain */
+    if (a->epilogue && !(HEADER(a->epilogue) & 2)){
+        blk = a->epilogue - (EVAL4B(a->epilogue - 8) + 8);
+        if (BLK_SZ(blk) >= TRIM_THRESHOLD){
+            prev_alloc = HEADER(blk) & 2;
+            detach_blk(a, BLK_SZ(blk), blk);
+            if (!trim_top(a, blk, prev_alloc))
+                attach_blk(a, BLK_SZ(blk), blk);
+        }
+    }
+    /* a treap keeps blocks smaller than a node to its left */
+    for (i = LBLK_IDX(TRIM_THRESHOLD); i < N_LBLK; i++){
+        if (!a->lrgblkl[i])
+            continue;
+        stack[0] = a->lrgblkl[i];
+        for (n = 1; n; ){
+            blk = heap_lo + stack[--n];
+            if (T_RIGHT(blk) && n < RELEASE_STACK)
+                stack[n++] = T_RIGHT(blk);
+            if (BLK_SZ(blk) < TRIM_THRESHOLD)
+                continue;
+            if (T_LEFT(blk) && n < RELEASE_STACK)
+                stack[n++] = T_LEFT(blk);
+            mem_release(blk + 8, BLK_SZ(blk) - 16);
+            STAT(releases);
+        }
+    }
+}
+
+/* merge_free - free a block of arena a, merging it with free
+ * neighbours
+ */
+static void merge_free(struct arena *a, void *ptr)
 {
-    if (!ptr)
-        return;
     int blk_sz = BLK_SZ(ptr);
     int merged_sz = blk_sz;
     int prev_alloc = 0;
@@ -407,11 +1131,9 @@ void free(void *ptr)
         merged = ptr - mark;
         if ((HEADER(merged) & 2))
             prev_alloc = 1;
-        if (SBLK_IDX(mark) < N_SBLK)
-            find_del_sblk(SBLK_IDX(mark), merged);
-        else
-            detach_lblk(LBLK_IDX(mark), merged);
+        detach_blk(a, mark, merged);
         merged_sz += mark;
+        STAT(merges);
     }
     else
         prev_alloc = 1;
@@ -419,58 +1141,918 @@ void free(void *ptr)
     mark = HEADER(ptr + blk_sz);
     if ((mark & 1) == 0){
         mark += 8;
-        if (SBLK_IDX(mark) < N_SBLK)
-            find_del_sblk(SBLK_IDX(mark), ptr + blk_sz);
-        else
-            detach_lblk(LBLK_IDX(mark), ptr + blk_sz);
+        detach_blk(a, mark, ptr + blk_sz);
         merged_sz += mark;
+        STAT(merges);
     }
     make_blk(merged_sz, merged);
     if (prev_alloc)
         HEADER(merged) |= 2;
-    if (SBLK_IDX(merged_sz) < N_SBLK)
-        attach_sblk(SBLK_IDX(merged_sz), merged);
-    else
-        attach_lblk(LBLK_IDX(merged_sz), merged);
+    attach_blk(a, merged_sz, merged);
+    /* free runs release_free once the count reaches 1, not here: the
+     * internal callers still hold blocks of the layout */
+    if (merged_sz >= TRIM_THRESHOLD && !a->release_wait)
+        a->release_wait = RELEASE_DELAY + 1;
+    else if (a->release_wait > 1)
+        a->release_wait--;
 }
 
-/*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
- */
-void *realloc(void *ptr, size_t size)
+#ifdef MM_QUICK
+/* consolidate - merge every block of the quick bins of arena a */
+static void consolidate(struct arena *a)
 {
-    void *new_p;
-    if (ptr == NULL)
-        return mm_malloc(size);
-    if (!size){
-        mm_free(ptr);
-        return NULL;
+    void *blk;
+    int i;
+    while (a->quick_map){
+        i = __builtin_ctz(a->quick_map);
+        while ((blk = OFF_BLK(a->quick[i])) != NULL){
+            a->quick[i] = L_NEXT(blk);
+            merge_free(a, blk);
+        }
+        a->quick_map &= ~(1u << i);
     }
-    /* space is enough */
-    if (PAYLD_SZ(ptr) + 4 >= size)
-        return ptr;
-    new_p = mm_malloc(size);
-    if (!new_p)
-        return NULL;
-    memcpy(new_p, ptr, PAYLD_SZ(ptr) + 4);
-    mm_free(ptr);
-    return new_p;
 }
+#endif
 
-/*
- * calloc - you may want to look at mm-naive.c
- * This function is not tested by mdriver, but it is
- * needed to run the traces.
+/* heap_free - free a allocated pointer of arena a. small blocks wait in
+ * the quick bins with -DMM_QUICK, others merge at once
  */
-void *calloc (size_t nmemb, size_t size) {
-    void *p = malloc(nmemb * size);
-    if (!p)
-        return NULL;
-    memset(p, 0, nmemb * size);
-    return p;
+static void heap_free(struct arena *a, void *ptr)
+{
+    if (!ptr)
+        return;
+#ifdef MM_SLAB
+    if (IS_SLAB(ptr)){
+        slab_free(a, ptr);
+        return;
+    }
+#endif
+#ifdef MM_LIFE
+    if (IS_NURSERY(ptr)){
+        life_free(a, ptr);
+        return;
+    }
+#endif
+#ifdef MM_QUICK
+    if (BLK_SZ(ptr) <= SBLK_SZ(N_SBLK - 1)){
+        int idx = SBLK_IDX(BLK_SZ(ptr));
+        /* the next owner starts without realloc history */
+        HEADER(ptr) &= ~4;
+        L_NEXT(ptr) = a->quick[idx];
+        a->quick[idx] = BLK_OFF(ptr);
+        a->quick_map |= 1u << idx;
+        return;
+    }
+#endif
+    merge_free(a, ptr);
 }
 
-/* function for setting break points
+/* shorten allocated block ptr of arena a to blk_sz, freeing the tail if
+ * it can make a block */
+static inline void trim_blk(struct arena *a, void *ptr, int blk_sz){
+    int left = BLK_SZ(ptr) - blk_sz;
+    if (left >= MIN_BLK_SZ){
+        HEADER(ptr) = (blk_sz - 8) | (HEADER(ptr) & 7);
+        HEADER(ptr + blk_sz) = (left - 8) | 3;
+        heap_free(a, ptr + blk_sz);
+        STAT(splits);
+    }
+}
+
+/*
+ * heap_realloc - resize allocated block ptr of arena a in place: shrink
+ *     it, grow it into a free next block or at the top of the heap, or
+ *     move it back into a free previous block. returns the block, or
+ *     NULL if it has to move elsewhere.
+ *     a block that grows again is taken to be a growing buffer: it gets
+ *     half as much again as spare room where that costs no heap growth,
+ *     keeps it until it shrinks to half, and if it has to move, it moves
+ *     to the top of the heap, where it can keep growing in place.
+ */
+static void *heap_realloc(struct arena *a, void *ptr, size_t size)
+{
+    int blk_sz = ALIGN(size + 4);
+    int cur = BLK_SZ(ptr);
+    int grown = HEADER(ptr) & 4;
+    int next_sz = 0, prev_sz, want, flags;
+    void *next = ptr + cur, *prev, *brk;
+    unsigned long len;
+    if (blk_sz < MIN_BLK_SZ)
+        blk_sz = MIN_BLK_SZ;
+    /* shrink, or space is enough */
+    if (cur >= blk_sz){
+        if (!grown)
+            trim_blk(a, ptr, blk_sz);
+        else if (blk_sz <= cur / 2){
+            HEADER(ptr) &= ~4;
+            trim_blk(a, ptr, blk_sz);
+        }
+        return ptr;
+    }
+    HEADER(ptr) |= 4;
+    want = grown ? ALIGN(blk_sz + blk_sz / 2) : blk_sz;
+    if (!(HEADER(next) & 1))
+        next_sz = BLK_SZ(next);
+    /* grow into the next block */
+    if (cur + next_sz >= blk_sz){
+        detach_blk(a, next_sz, next);
+        HEADER(ptr) = (cur + next_sz - 8) | (HEADER(ptr) & 7);
+        HEADER(next + next_sz) |= 2;
+        trim_blk(a, ptr, want);
+        return ptr;
+    }
+    /* grow at the top of the heap, like extend */
+    SBRK_LOCK();
+    brk = mem_heap_hi() + 1;
+    if (next + next_sz == a->epilogue && brk - a->epilogue <= 8){
+        len = CHUNK_UP((unsigned long)(ptr + blk_sz + 8 - heap_lo)) -
+            (unsigned long)(brk - heap_lo);
+        if (mem_sbrk((int)len) == (void*)-1){
+            SBRK_UNLOCK();
+            return NULL;
+        }
+#ifdef MM_THREADS
+        set_owner(brk, len, a);
+#endif
+        SBRK_UNLOCK();
+        if (next_sz)
+            detach_blk(a, next_sz, next);
+        a->epilogue = brk + len - 8;
+        HEADER(a->epilogue) = 3u;
+        EVAL4B(a->epilogue) = 1u;
+        HEADER(ptr) = (int)(a->epilogue - ptr - 8) | (HEADER(ptr) & 7);
+        trim_blk(a, ptr, blk_sz);
+        return ptr;
+    }
+    SBRK_UNLOCK();
+    /* move back into the previous block */
+    if (!(HEADER(ptr) & 2)){
+        prev_sz = EVAL4B(ptr - 8) + 8;
+        if (prev_sz + cur + next_sz >= blk_sz){
+            prev = ptr - prev_sz;
+            flags = HEADER(ptr) & 4;
+            detach_blk(a, prev_sz, prev);
+            if (next_sz)
+                detach_blk(a, next_sz, next);
+            memmove(prev, ptr, cur - 4);
+            HEADER(prev) = (prev_sz + cur + next_sz - 8) | (HEADER(prev) & 2) |
+                flags | 1;
+            HEADER(next + next_sz) |= 2;
+            trim_blk(a, prev, want);
+            return prev;
+        }
+    }
+    /* a growing buffer moves to the top of the heap, if the arena is
+     * there: a new chunk would not let it grow in place for long */
+    if (grown && mem_heap_hi() + 1 - a->epilogue <= 8 &&
+            (prev = extend(a, want)) != NULL){
+        memcpy(prev, ptr, cur - 4);
+        HEADER(prev) |= 4;
+        heap_free(a, ptr);
+        return prev;
+    }
+    return NULL;
+}
+
+/* first aligned payload in block blk that leaves room for a free block
+ * in front of it */
+static inline void *align_in(void *blk, unsigned long align){
+    if (!((unsigned long)blk & (align - 1)))
+        return blk;
+    return VPTR(((unsigned long)blk + MIN_BLK_SZ + align - 1) & ~(align - 1));
+}
+
+/* the smallest block of the treap at off holding an aligned block of
+ * blk_sz, walking the blocks of at least blk_sz in order of size. each
+ * node visited costs one of *probes; NULL once they run out */
+static void *tree_aligned(unsigned int off, int blk_sz, unsigned long align,
+        int *probes){
+    unsigned int stack[ALIGN_PROBES];
+    void *blk_p;
+    int n = 0;
+    for (;;){
+        /* down to the smallest block of the subtree that is large enough */
+        for (; off; off = (int)BLK_SZ(blk_p) >= blk_sz ?
+                T_LEFT(blk_p) : T_RIGHT(blk_p)){
+            if (--*probes < 0)
+                return NULL;
+            blk_p = heap_lo + off;
+            if ((int)BLK_SZ(blk_p) >= blk_sz)
+                stack[n++] = off;
+        }
+        if (!n)
+            return NULL;
+        blk_p = heap_lo + stack[--n];
+        if (align_in(blk_p, align) + blk_sz <= blk_p + BLK_SZ(blk_p))
+            return blk_p;
+        off = T_RIGHT(blk_p);
+    }
+}
+
+/* find a large block holding an aligned block of blk_sz within
+ * ALIGN_PROBES treap nodes */
+static void *find_lblk_aligned(struct arena *a, int blk_sz,
+        unsigned long align, int *idx){
+    void *blk_p;
+    int probes = ALIGN_PROBES;
+    for (*idx = next_lgrp(a, LBLK_IDX(blk_sz)); *idx < N_LBLK && probes > 0;
+            *idx = next_lgrp(a, *idx + 1))
+        if ((blk_p = tree_aligned(a->lrgblkl[*idx], blk_sz, align,
+                &probes)) != NULL)
+            return blk_p;
+    return NULL;
+}
+
+/*
+ * heap_malloc_aligned - allocate a block of arena a whose payload holds
+ *     size bytes and starts at a multiple of align, a power of two.
+ *     the parts of a larger block before and after it are freed again.
+ */
+static void *heap_malloc_aligned(struct arena *a, size_t size, size_t align)
+{
+    int blk_sz = ALIGN(size + 4);
+    int idx, gap;
+    size_t need = size + align + MIN_BLK_SZ;
+    void *ptr, *al;
+    if (blk_sz < MIN_BLK_SZ)
+        blk_sz = MIN_BLK_SZ;
+#ifdef MM_SLAB
+    /* a slab object has no header to split */
+    if (need <= SLAB_MAX)
+        need = SLAB_MAX + 1;
+#endif
+    if ((ptr = find_lblk_aligned(a, blk_sz, align, &idx)) != NULL){
+        detach_lblk(a, idx, ptr);
+        mark_used(ptr);
+    }
+    /* no block found in ALIGN_PROBES nodes, split one large enough to
+     * align anyhow */
+    else if ((ptr = heap_malloc(a, need)) == NULL)
+        return NULL;
+    al = align_in(ptr, align);
+    if (al != ptr){
+        gap = al - ptr;
+        HEADER(al) = (BLK_SZ(ptr) - gap - 8) | 3;
+        HEADER(ptr) = (gap - 8) | (HEADER(ptr) & 2) | 1;
+        heap_free(a, ptr);
+    }
+    trim_blk(a, al, blk_sz);
+    return al;
+}
+
+#ifdef MM_SLAB
+/* put a run at the front of the list of its size */
+static inline void run_link(struct arena *a, struct run *r){
+    struct run **head = &a->slab[(r->cls_sz >> 3) - 1];
+    r->prev = NULL;
+    r->next = *head;
+    if (*head)
+        (*head)->prev = r;
+    *head = r;
+}
+
+static inline void run_unlink(struct arena *a, struct run *r){
+    if (r->prev)
+        r->prev->next = r->next;
+    else
+        a->slab[(r->cls_sz >> 3) - 1] = r->next;
+    if (r->next)
+        r->next->prev = r->prev;
+}
+
+/* carve a new run for objects of cls_sz bytes. the block of a run is
+ * one page exactly: the last 4 bytes of the page hold the header of the
+ * next block, so runs can follow each other without gaps */
+static struct run *new_run(struct arena *a, int cls_sz){
+    struct run *r = heap_malloc_aligned(a, RUN_SZ - 4, RUN_SZ);
+    int i;
+    if (!r)
+        return NULL;
+    r->cls_sz = cls_sz;
+    r->nobj = r->nfree = (RUN_SZ - 4 - RUN_START) / cls_sz;
+    memset(r->map, 0, sizeof(r->map));
+    for (i = 0; i < r->nobj >> 6; i++)
+        r->map[i] = ~0ull;
+    if (r->nobj & 63)
+        r->map[i] = (1ull << (r->nobj & 63)) - 1;
+    pagemap[(unsigned long)(VPTR(r) - heap_lo) >> RUN_SHIFT] = PG_SLAB;
+    run_link(a, r);
+    return r;
+}
+
+/* take the first free slot of a run of the right size. returns NULL
+ * while the size is not warm yet */
+static void *slab_alloc(struct arena *a, size_t size){
+    int c = size ? (int)(size - 1) >> 3 : 0;
+    struct run *r = a->slab[c];
+    int w, bit;
+    if (!r){
+        if (a->warm[c] < SLAB_WARM){
+            a->warm[c]++;
+            return NULL;
+        }
+        if ((r = new_run(a, (c + 1) << 3)) == NULL)
+            return NULL;
+    }
+    for (w = 0; !r->map[w]; w++)
+        ;
+    bit = __builtin_ctzll(r->map[w]);
+    r->map[w] &= r->map[w] - 1;
+    if (--r->nfree == 0)
+        run_unlink(a, r);
+    return VPTR(r) + RUN_START + (w * 64 + bit) * r->cls_sz;
+}
+
+static void slab_free(struct arena *a, void *ptr){
+    struct run *r = RUN_OF(ptr);
+    int i = (int)(ptr - VPTR(r) - RUN_START) / r->cls_sz;
+    r->map[i >> 6] |= 1ull << (i & 63);
+    if (r->nfree++ == 0)
+        run_link(a, r);
+    /* give an empty run back, unless it is the last of its size */
+    else if (r->nfree == r->nobj && (r->prev || r->next)){
+        run_unlink(a, r);
+        pagemap[(unsigned long)(VPTR(r) - heap_lo) >> RUN_SHIFT] = PG_HEAP;
+        heap_free(a, r);
+    }
+}
+#endif /* def MM_SLAB */
+
+#ifdef MM_LIFE
+/* move the prediction for objects of cls * 8 bytes by d */
+static inline void life_vote(int cls, int d){
+    int v = life_pred[cls] + d;
+    life_pred[cls] = v > LIFE_BOUND ? LIFE_BOUND :
+        v < -LIFE_BOUND ? -LIFE_BOUND : v;
+}
+
+/* give a nursery without objects back to the heap */
+static void nursery_drop(struct arena *a, struct nursery *n){
+    nursery_map[(unsigned long)(VPTR(n) - heap_lo) >> NURSERY_SHIFT] = 0;
+    heap_free(a, n);
+}
+
+/* stop allocating from the full nursery of arena a. the sizes of the
+ * objects in it that already lived long are predicted to live longer,
+ * the younger ones vote when freed. it is given back when its last
+ * object is freed */
+static void nursery_retire(struct arena *a, struct nursery *n){
+    void *p;
+    for (p = VPTR(n) + 16; p - 8 < VPTR(n) + n->top; p += PAYLD_SZ(p) + 8)
+        if ((HEADER(p) & 1) && a->clock - BIRTH(p) > LIFE_SHORT)
+            life_vote(PAYLD_SZ(p) >> 3, -2);
+    a->nursery = NULL;
+}
+
+/* life_alloc - take size bytes from the nursery if objects of that size
+ *     are predicted to die young. returns NULL to leave the request to
+ *     the heap */
+static void *life_alloc(struct arena *a, size_t size){
+    /* an empty payload would read as a mapped block */
+    unsigned int cap = size ? ALIGN(size) : ALIGNMENT;
+    struct nursery *n = a->nursery;
+    void *p;
+    if (life_pred[cap >> 3] <= 0)
+        return NULL;
+    if (!n || n->top + 8 + cap > NURSERY_SZ - 4){
+        /* a small heap cannot afford the space of a nursery */
+        if (mem_heap_hi() + 1 - heap_lo < LIFE_WARM * NURSERY_SZ)
+            return NULL;
+        if (n)
+            nursery_retire(a, n);
+        if ((n = heap_malloc_aligned(a, NURSERY_SZ - 4, NURSERY_SZ)) == NULL)
+            return NULL;
+        nursery_map[(unsigned long)(VPTR(n) - heap_lo) >> NURSERY_SHIFT] = 1;
+        n->live = 0;
+        n->top = sizeof(struct nursery);
+        a->nursery = n;
+    }
+    p = VPTR(n) + n->top + 8;
+    BIRTH(p) = a->clock;
+    HEADER(p) = cap | 1;
+    n->top += cap + 8;
+    n->live++;
+    return p;
+}
+
+/* life_free - free a nursery object, and learn from its age. an empty
+ *     nursery starts over, or goes back to the heap once retired */
+static void life_free(struct arena *a, void *ptr){
+    struct nursery *n = NURSERY_OF(ptr);
+    unsigned int cap = PAYLD_SZ(ptr);
+    life_vote(cap >> 3, a->clock - BIRTH(ptr) <= LIFE_SHORT ? 1 : -2);
+    HEADER(ptr) &= ~1;
+    /* the last object gives its space back at once */
+    if (VPTR(n) + n->top == ptr + cap)
+        n->top -= cap + 8;
+    if (--n->live)
+        return;
+    if (n == a->nursery)
+        n->top = sizeof(struct nursery);
+    else
+        nursery_drop(a, n);
+}
+
+/* life_probe - time heap object ptr of size bytes if it is the probe of
+ *     its size. a slot still taken by a probe old enough votes against
+ *     that probe's size and is reused */
+static void life_probe(struct arena *a, size_t size, void *ptr){
+    int cls = (size ? ALIGN(size) : ALIGNMENT) >> 3;
+    struct life_probe *s;
+    if (++life_cnt[cls] % LIFE_PROBE)
+        return;
+    s = &life_probes[PROBE_SLOT(BLK_OFF(ptr))];
+    if (s->off){
+        if (a->clock - s->birth <= LIFE_SHORT)
+            return;
+        life_vote(s->cls, -2);
+    }
+    s->off = BLK_OFF(ptr);
+    s->birth = a->clock;
+    s->cls = cls;
+}
+
+/* life_unprobe - learn from the age of heap object ptr if it is a probe */
+static inline void life_unprobe(struct arena *a, void *ptr){
+    struct life_probe *s = &life_probes[PROBE_SLOT(BLK_OFF(ptr))];
+    if (s->off == BLK_OFF(ptr)){
+        life_vote(s->cls, a->clock - s->birth <= LIFE_SHORT ? 1 : -2);
+        s->off = 0;
+    }
+}
+#endif /* def MM_LIFE */
+
+/* bytes the caller may use in block ptr */
+static inline size_t usable_sz(void *ptr){
+#ifdef MM_SLAB
+    if (IS_SLAB(ptr))
+        return RUN_OF(ptr)->cls_sz;
+#endif
+#ifdef MM_LIFE
+    if (IS_NURSERY(ptr))
+        return PAYLD_SZ(ptr);
+#endif
+    if (IS_MAPPED(ptr))
+        return MAP_LEN(ptr) - 16;
+    return PAYLD_SZ(ptr) + 4;
+}
+
+#ifdef MM_STATS
+/* class of a block whose payload holds sz bytes */
+static inline int stat_cls(size_t sz){
+    unsigned int blk_sz = ALIGN(sz + 4);
+    if (blk_sz <= SBLK_SZ(N_SBLK - 1))
+        return SBLK_IDX(blk_sz < MIN_BLK_SZ ? MIN_BLK_SZ : blk_sz);
+    return N_SBLK + LBLK_IDX(blk_sz);
+}
+
+/* count block ptr handed out */
+static void *stat_alloc(void *ptr){
+    size_t sz;
+    if (!ptr)
+        return NULL;
+    sz = usable_sz(ptr);
+    STAT(nmalloc[IS_MAPPED(ptr) ? MAP_CLS : stat_cls(sz)]);
+    STAT_ADD(live, sz);
+    if (stats.live > stats.peak_live)
+        stats.peak_live = stats.live;
+    return ptr;
+}
+
+/* count block ptr given back */
+static void stat_free(void *ptr){
+    size_t sz = usable_sz(ptr);
+    STAT(nfree[IS_MAPPED(ptr) ? MAP_CLS : stat_cls(sz)]);
+    STAT_ADD(live, -sz);
+}
+
+/* count a block resized in place from old_sz usable bytes */
+static void *stat_resize(void *ptr, size_t old_sz){
+    if (!ptr)
+        return NULL;
+    STAT_ADD(live, usable_sz(ptr) - old_sz);
+    if (stats.live > stats.peak_live)
+        stats.peak_live = stats.live;
+    return ptr;
+}
+#endif /* def MM_STATS */
+
+/* length of a mapping for a block of size bytes. sizes past MAP_MAX
+ * would wrap it */
+#define MAP_MAX (SIZE_MAX - 16 - mem_pagesize())
+static inline size_t map_len(size_t size){
+    return (size + 16 + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+}
+
+/* map_malloc - give a huge request a mapping of its own */
+static void *map_malloc(size_t size)
+{
+    size_t len;
+    void *p;
+    if (size > MAP_MAX)
+        return NULL;
+    len = map_len(size);
+    SBRK_LOCK();
+    p = mem_map(len);
+    SBRK_UNLOCK();
+    if (!p)
+        return NULL;
+    *(size_t*)p = len;
+    HEADER(p + 16) = 1u | 2;
+    return p + 16;
+}
+
+/* map_free - unmap a mapped block */
+static void map_free(void *ptr)
+{
+    SBRK_LOCK();
+    mem_unmap(ptr - 16, MAP_LEN(ptr));
+    SBRK_UNLOCK();
+}
+
+/* map_realloc - resize a mapped block, it may move */
+static void *map_realloc(void *ptr, size_t size)
+{
+    size_t len;
+    void *p;
+    if (size > MAP_MAX)
+        return NULL;
+    len = map_len(size);
+    if (len == MAP_LEN(ptr))
+        return ptr;
+    SBRK_LOCK();
+    p = mem_remap(ptr - 16, MAP_LEN(ptr), len);
+    SBRK_UNLOCK();
+    if (!p)
+        return NULL;
+    *(size_t*)p = len;
+    return p + 16;
+}
+
+#ifdef MM_THREADS
+/* push a block freed by another thread onto the remote queue of its
+ * arena. the owner takes the whole queue at once, so there is no ABA */
+static inline void remote_push(struct arena *a, void *blk){
+    void *head;
+    do {
+        head = a->remote;
+        TC_NEXT(blk) = head;
+    } while (!__sync_bool_compare_and_swap(&a->remote, head, blk));
+}
+
+/* free the blocks other threads queued for arena a, arena lock held */
+static void drain_remote(struct arena *a){
+    void *blk = __sync_lock_test_and_set(&a->remote, NULL);
+    void *next;
+    for (; blk; blk = next){
+        next = TC_NEXT(blk);
+        heap_free(a, blk);
+    }
+}
+
+/* arena for a thread that allocates for the first time */
+static struct arena *pick_arena(void){
+#ifdef MM_ARENA_CPU
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+        return &arenas[cpu % MM_ARENAS];
+#endif
+    return &arenas[__sync_fetch_and_add(&next_arena, 1) % MM_ARENAS];
+}
+
+/* drop blocks cached for an old heap, register the exit flush once */
+static void tc_exit(void *arg);
+
+static void tc_key_init(void){
+    pthread_key_create(&tc_key, tc_exit);
+}
+
+static inline struct tcache *my_tcache(void){
+    if (tc.gen != heap_gen){
+        if (!tc.gen){
+            pthread_once(&tc_once, tc_key_init);
+            pthread_setspecific(tc_key, &tc);
+        }
+        memset(&tc, 0, sizeof(tc));
+        tc.gen = heap_gen;
+        tc.ar = pick_arena();
+    }
+    return &tc;
+}
+
+#ifndef MM_SLAB
+/* push a small block onto its list in a thread cache */
+static inline void tc_push(struct tcache *t, void *blk){
+    int idx = SBLK_IDX(BLK_SZ(blk));
+    /* the next owner starts without realloc history */
+    HEADER(blk) &= ~4;
+    TC_NEXT(blk) = t->head[idx];
+    t->head[idx] = blk;
+    t->cnt[idx]++;
+}
+#endif
+
+/* return n blocks of list idx to their arenas, lock of the thread's
+ * arena held. blocks of other arenas go to their remote queues */
+static void tc_flush(struct tcache *t, int idx, int n){
+    void *blk;
+    struct arena *a;
+    while (n-- && (blk = t->head[idx]) != NULL){
+        t->head[idx] = TC_NEXT(blk);
+        t->cnt[idx]--;
+        if ((a = arena_of(blk)) == t->ar)
+            heap_free(a, blk);
+        else
+            remote_push(a, blk);
+    }
+}
+
+/* thread exit: give all cached blocks back */
+static void tc_exit(void *arg){
+    struct tcache *t = arg;
+    int i;
+    if (t->gen != heap_gen)
+        return;
+    LOCK(t->ar);
+    for (i = 0; i < N_SBLK; i++)
+        tc_flush(t, i, t->cnt[i]);
+    UNLOCK(t->ar);
+    t->gen = 0;
+}
+
+#ifndef MM_SLAB
+/* allocate a batch of blocks for size under one lock. the first one is
+ * returned, the others are cached */
+static void *tc_refill(struct tcache *t, size_t size){
+    struct arena *a = t->ar;
+    void *ret, *blk;
+    int i;
+    LOCK(a);
+    if (a->remote)
+        drain_remote(a);
+    ret = heap_malloc(a, size);
+    for (i = 1; ret && i < TC_BATCH; i++){
+        if ((blk = heap_malloc(a, size)) == NULL)
+            break;
+        /* a split may leave a block too large for the cache */
+        if (BLK_SZ(blk) > SBLK_SZ(N_SBLK - 1)){
+            heap_free(a, blk);
+            break;
+        }
+        tc_push(t, blk);
+    }
+    UNLOCK(a);
+    return ret;
+}
+#endif
+#endif /* def MM_THREADS */
+
+/*
+ * mm_malloc - allocate a block. huge blocks are mapped, small blocks come
+ *     from the thread's cache in thread-safe mode, others from the
+ *     thread's arena.
+ */
+void *malloc(size_t size)
+{
+    struct arena *a = arenas;
+    void *ptr;
+    if (size >= MMAP_THRESHOLD && (ptr = map_malloc(size)) != NULL)
+        return COUNTED(ptr);
+    /* the heap cannot hold what could not be mapped */
+    if (size > MAX_HEAP)
+        return NULL;
+#ifdef MM_LIFE
+    a->clock++;
+    if (size <= LIFE_MAX && (ptr = life_alloc(a, size)) != NULL)
+        return COUNTED(ptr);
+#endif
+#ifdef MM_THREADS
+    struct tcache *t = my_tcache();
+#ifndef MM_SLAB
+    if (size + 4 <= SBLK_SZ(N_SBLK - 1)){
+        int blk_sz = ALIGN(size + 4);
+        int idx = SBLK_IDX(blk_sz < MIN_BLK_SZ ? MIN_BLK_SZ : blk_sz);
+        if ((ptr = t->head[idx]) != NULL){
+            t->head[idx] = TC_NEXT(ptr);
+            t->cnt[idx]--;
+            return COUNTED(ptr);
+        }
+        return COUNTED(tc_refill(t, size));
+    }
+#endif
+    a = t->ar;
+#endif
+    LOCK(a);
+#ifdef MM_THREADS
+    if (a->remote)
+        drain_remote(a);
+#endif
+    ptr = heap_malloc(a, size);
+    UNLOCK(a);
+#ifdef MM_LIFE
+    if (ptr && size <= LIFE_MAX)
+        life_probe(a, size, ptr);
+#endif
+    return COUNTED(ptr);
+}
+
+/*
+ * mm_free - free a block. mapped blocks are unmapped, small blocks go to
+ *     the thread's cache in thread-safe mode, and the cache is trimmed when
+ *     it grows too long. blocks of a busy foreign arena are queued for
+ *     its owner.
+ */
+void free(void *ptr)
+{
+    if (!ptr)
+        return;
+    STAT_FREE(ptr);
+    if (IS_MAPPED(ptr)){
+        map_free(ptr);
+        return;
+    }
+#ifdef MM_THREADS
+    struct tcache *t = my_tcache();
+    struct arena *a;
+#ifndef MM_SLAB
+    if (BLK_SZ(ptr) <= SBLK_SZ(N_SBLK - 1)){
+        int idx = SBLK_IDX(BLK_SZ(ptr));
+        tc_push(t, ptr);
+        if (t->cnt[idx] > TC_MAX){
+            LOCK(t->ar);
+            tc_flush(t, idx, TC_BATCH);
+            UNLOCK(t->ar);
+        }
+        return;
+    }
+#endif
+    a = arena_of(ptr);
+    if (a == t->ar)
+        LOCK(a);
+    else if (pthread_mutex_trylock(&a->lock)){
+        remote_push(a, ptr);
+        return;
+    }
+    heap_free(a, ptr);
+    if (a->release_wait == 1)
+        release_free(a);
+    UNLOCK(a);
+#else
+#ifdef MM_LIFE
+    arenas->clock++;
+    life_unprobe(arenas, ptr);
+#endif
+    heap_free(arenas, ptr);
+    if (arenas->release_wait == 1)
+        release_free(arenas);
+#endif
+}
+
+/*
+ * mm_realloc - resize the block in place if its neighbours allow (under
+ *     the lock of its arena), otherwise mm_malloc, copy and mm_free.
+ *     objects of slab runs only stay in place if they are large enough.
+ *     mapped blocks are remapped while they stay huge.
+ */
+void *realloc(void *ptr, size_t size)
+{
+    struct arena *a = arenas;
+    void *new_p;
+    size_t old_sz;
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (!size){
+        mm_free(ptr);
+        return NULL;
+    }
+    STAT(nrealloc);
+    old_sz = usable_sz(ptr);
+    if (IS_MAPPED(ptr)){
+        if (size >= MMAP_THRESHOLD)
+            return RESIZED(map_realloc(ptr, size), old_sz);
+    }
+#ifdef MM_SLAB
+    else if (IS_SLAB(ptr)){
+        /* space is enough */
+        if (old_sz >= size)
+            return ptr;
+    }
+#endif
+#ifdef MM_LIFE
+    else if (IS_NURSERY(ptr)){
+        if (old_sz >= size)
+            return ptr;
+    }
+#endif
+    /* a block growing past MMAP_THRESHOLD moves to a mapping */
+    else if (size < MMAP_THRESHOLD || size <= old_sz){
+#ifdef MM_THREADS
+        a = arena_of(ptr);
+#endif
+        LOCK(a);
+        new_p = heap_realloc(a, ptr, size);
+        UNLOCK(a);
+        if (new_p)
+            return RESIZED(new_p, old_sz);
+    }
+    new_p = mm_malloc(size);
+    if (!new_p)
+        return NULL;
+    memcpy(new_p, ptr, old_sz < size ? old_sz : size);
+    mm_free(ptr);
+#ifdef MM_SLAB
+    if (IS_SLAB(new_p))
+        return new_p;
+#endif
+#ifdef MM_LIFE
+    if (IS_NURSERY(new_p))
+        return new_p;
+#endif
+    /* remember that it grew */
+    if (size > old_sz && !IS_MAPPED(new_p))
+        HEADER(new_p) |= 4;
+    return new_p;
+}
+
+/*
+ * memalign - allocate size bytes at a multiple of align, a power of two.
+ *     the block is carved out of a free block, or out of a block large
+ *     enough to align anyhow, and the parts before and after it go back
+ *     to the free lists. aligned blocks always come from the heap.
+ */
+void *memalign(size_t align, size_t size)
+{
+    struct arena *a = arenas;
+    void *ptr;
+    /* the block is cut from one of size + align + MIN_BLK_SZ bytes */
+    if ((align & (align - 1)) || align > MAX_HEAP - MIN_BLK_SZ ||
+            size > MAX_HEAP - align - MIN_BLK_SZ)
+        return NULL;
+    if (align <= ALIGNMENT)
+        return malloc(size);
+#ifdef MM_THREADS
+    a = my_tcache()->ar;
+#endif
+    LOCK(a);
+#ifdef MM_THREADS
+    if (a->remote)
+        drain_remote(a);
+#endif
+    ptr = heap_malloc_aligned(a, size, align);
+    UNLOCK(a);
+    return COUNTED(ptr);
+}
+
+/* aligned_alloc - C11 name of memalign */
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+/* posix_memalign - memalign returning an error number */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *ptr;
+    if ((align & (align - 1)) || align < sizeof(void*))
+        return EINVAL;
+    if ((ptr = memalign(align, size)) == NULL)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+/*
+ * calloc - only clear what may not be zero. a fresh mapping is zero,
+ *     and so is heap memory above mem_heap_zero, except for what malloc
+ *     itself wrote into the block: free block links in its first 8 bytes
+ *     and a footer in its last 4. clearing a block taken from fresh
+ *     memory takes constant time. the heap can grow under another
+ *     thread in thread-safe mode, so there only mappings are skipped.
+ */
+void *calloc (size_t nmemb, size_t size) {
+    size_t bytes = nmemb * size;
+    void *p;
+#ifndef MM_THREADS
+    void *zero = mem_heap_zero();
+#endif
+    if (nmemb && bytes / nmemb != size)
+        return NULL;
+    if ((p = malloc(bytes)) == NULL)
+        return NULL;
+    if (IS_MAPPED(p))
+        return p;
+#ifndef MM_THREADS
+    if (p + bytes > zero && bytes >= 16){
+        memset(p, 0, p + 8 < zero ? (size_t)(zero - p) : 8);
+        memset(p + bytes - 8, 0, 8);
+        return p;
+    }
+#endif
+    memset(p, 0, bytes);
+    return p;
+}
+
+/* function for setting break points
  *  trys to evaluate memory at ptr, gives fault when ptr is NULL.
  */
 void make_error(void *ptr){
@@ -478,41 +2060,131 @@ void make_error(void *ptr){
     printf("0x%lx\n", val);
 }
 
+static void checkheap(int verbose);
+
+/* locks every arena, in order, while checking */
 void mm_checkheap(int verbose){
-    void *blk = prologue;
-    void *high = mem_heap_hi() + 1;
-    void *next;
-    unsigned int blk_sz;
     int i;
-    verbose = verbose;
-    if (epilogue + 4 > high){
-        printf("epilogue outside boundary.");
+    for (i = 0; i < MM_ARENAS; i++)
+        LOCK(&arenas[i]);
+    checkheap(verbose);
+    for (i = MM_ARENAS - 1; i >= 0; i--)
+        UNLOCK(&arenas[i]);
+}
+
+#ifdef MM_STATS
+/*
+ * mm_stats_dump - write the counters since mm_init to fp as a JSON
+ *     object, with the free blocks of the heap walked under the locks of
+ *     every arena. blocks in thread caches count as in use.
+ */
+void mm_stats_dump(FILE *fp){
+    void *blk = prologue, *high = mem_heap_hi() + 1;
+    unsigned long free_bytes = 0, largest = 0, n_free = 0;
+    int i, last;
+    for (i = 0; i < MM_ARENAS; i++)
+        LOCK(&arenas[i]);
+    while (blk){
+        if ((HEADER(blk) & 1) == 0){
+            n_free++;
+            free_bytes += BLK_SZ(blk);
+            if (BLK_SZ(blk) > largest)
+                largest = BLK_SZ(blk);
+        }
+        blk += BLK_SZ(blk);
+        if (PAYLD_SZ(blk) == 0)
+            blk = blk + 8 >= high ? NULL : blk + 16;
+    }
+    for (i = MM_ARENAS - 1; i >= 0; i--)
+        UNLOCK(&arenas[i]);
+    fprintf(fp, "{\"malloc\": [");
+    for (i = 0; i < N_STAT_CLS; i++)
+        fprintf(fp, "%s%lu", i ? ", " : "", stats.nmalloc[i]);
+    fprintf(fp, "], \"free\": [");
+    for (i = 0; i < N_STAT_CLS; i++)
+        fprintf(fp, "%s%lu", i ? ", " : "", stats.nfree[i]);
+    /* lower bound of the block sizes of each class, 0 for mapped */
+    fprintf(fp, "], \"class_min\": [");
+    for (i = 0; i < N_STAT_CLS; i++)
+        fprintf(fp, "%s%u", i ? ", " : "", i < N_SBLK ? SBLK_SZ(i) :
+                i < MAP_CLS ? LBLK_SZ(i - N_SBLK) : 0);
+    fprintf(fp, "], \"realloc\": %lu, \"search\": [", stats.nrealloc);
+    for (last = N_SEARCH; last > 1 && !stats.search[last - 1]; last--)
+        ;
+    for (i = 0; i < last; i++)
+        fprintf(fp, "%s%lu", i ? ", " : "", stats.search[i]);
+    fprintf(fp, "], \"splits\": %lu, \"merges\": %lu, \"extends\": %lu, "
+            "\"trims\": %lu, \"releases\": %lu, ", stats.splits,
+            stats.merges, stats.extends, stats.trims, stats.releases);
+    fprintf(fp, "\"live\": %lu, \"peak_live\": %lu, \"heap\": %lu, "
+            "\"peak_heap\": %lu, ", stats.live, stats.peak_live,
+            (unsigned long)(mem_heapsize() + mem_mapsize()),
+            (unsigned long)mem_peak_heapsize());
+    fprintf(fp, "\"free_blocks\": %lu, \"free_bytes\": %lu, "
+            "\"largest_free\": %lu, \"fragmentation\": %.4f}",
+            n_free, free_bytes, largest,
+            free_bytes ? 1 - (double)largest / free_bytes : 0.0);
+}
+#endif /* def MM_STATS */
+
+/* check the treap at off of large group i of arena a, whose blocks
+ * come after lo and before hi (unbounded if NULL), return its size */
+static unsigned int check_tree(struct arena *a, int i, unsigned int off,
+        void *lo, void *hi, void *high){
+    void *blk = OFF_BLK(off);
+    unsigned int blk_sz;
+    if (!blk)
+        return 0;
+    if (blk <= prologue || blk >= high){
+        printf("outside boundary. 0x%lx\n", (unsigned long)blk);
         make_error(NULL);
     }
-    /*for (i = 0; i < 3; i++){
-        blk = special_p[i];
-        while(blk){
-            if (blk <= prologue || blk >= epilogue){
-                printf("outside boundary. 0x%lx\n", (unsigned long)blk);
-                make_error(NULL);
-            }
-            if ((HEADER(blk) & 1) == 0){
-                printf("free blk not in free list. 0x%lx\n", (unsigned long)blk);
-                make_error(NULL);
-            }
-            blk_sz = BLK_SZ(blk);
-            if (blk_sz < SP_BLK_SZ){
-                printf("special block too small. 0x%lx\n", (unsigned long)blk);
-                make_error(NULL);
-            }
-            blk = L_NEXT(blk);
-        }
-    }*/
+    if (HEADER(blk) & 1){
+        printf("allocated blk in free list. 0x%lx\n", (unsigned long)blk);
+        make_error(NULL);
+    }
+    blk_sz = BLK_SZ(blk);
+    if (blk_sz < LBLK_SZ(i) || (i + 1 < N_LBLK && blk_sz >= LBLK_SZ(i + 1))){
+        printf("wrong block size. 0x%lx\n", (unsigned long)blk);
+        make_error(NULL);
+    }
+    if ((lo && !T_BEFORE(lo, blk)) || (hi && !T_BEFORE(blk, hi))){
+        printf("treap out of order. 0x%lx\n", (unsigned long)blk);
+        make_error(NULL);
+    }
+    if ((T_LEFT(blk) && T_PRIO(T_LEFT(blk)) > T_PRIO(off)) ||
+            (T_RIGHT(blk) && T_PRIO(T_RIGHT(blk)) > T_PRIO(off))){
+        printf("treap priority error. 0x%lx\n", (unsigned long)blk);
+        make_error(NULL);
+    }
+#ifdef MM_THREADS
+    if (arena_of(blk) != a){
+        printf("blk in free list of wrong arena. 0x%lx\n", (unsigned long)blk);
+        make_error(NULL);
+    }
+#endif
+    return 1 + check_tree(a, i, T_LEFT(blk), lo, blk, high) +
+        check_tree(a, i, T_RIGHT(blk), blk, hi, high);
+}
+
+/* check the free lists of one arena, return number of blocks in them */
+static unsigned int check_lists(struct arena *a, void *high){
+    void *blk;
+    unsigned int blk_sz, n = 0;
+    int i;
     /* test small block free list */
     for (i = 0; i < N_SBLK; i++){
-        blk = smlblkl_p[i];
+        blk = OFF_BLK(a->smlblkl[i]);
+        if (!blk != !(a->sml_map & (1u << i))){
+            printf("small group %d: wrong bitmap\n", i);
+            make_error(NULL);
+        }
+        if (blk && L_PREV(blk)){
+            printf("first block wrong prev offset. 0x%lx\n", (unsigned long)blk);
+            make_error(NULL);
+        }
         while(blk){
-            if (blk <= prologue || blk >= epilogue){
+            if (blk <= prologue || blk >= high){
                 printf("outside boundary. 0x%lx\n", (unsigned long)blk);
                 make_error(NULL);
             }
@@ -525,60 +2197,160 @@ void mm_checkheap(int verbose){
                 printf("wrong block size. 0x%lx\n", (unsigned long)blk);
                 make_error(NULL);
             }
-            blk = L_NEXT(blk);
+            if (L_NEXT(blk) && L_PREV(OFF_BLK(L_NEXT(blk))) != BLK_OFF(blk)){
+                printf("double link error. 0x%lx\n", (unsigned long)blk);
+                make_error(NULL);
+            }
+#ifdef MM_THREADS
+            if (arena_of(blk) != a){
+                printf("blk in free list of wrong arena. 0x%lx\n", (unsigned long)blk);
+                make_error(NULL);
+            }
+#endif
+            n++;
+            blk = OFF_BLK(L_NEXT(blk));
         }
     }
     /* test large block free list */
     for (i = 0; i < N_LBLK; i++){
-        blk = lrgblkl_p[i];
-        if (blk && L_PREV(blk)){
-            printf("first block wrong prev ptr. 0x%lx\n", (unsigned long)blk);
+        blk = OFF_BLK(a->lrgblkl[i]);
+        if (!blk != !(a->lrg_map & (1ull << i))){
+            printf("large group %d: wrong bitmap\n", i);
             make_error(NULL);
         }
-        while(blk){
-            if (blk <= prologue || blk >= epilogue){
-                printf("outside boundary. 0x%lx\n", (unsigned long)blk);
+        n += check_tree(a, i, a->lrgblkl[i], NULL, NULL, high);
+    }
+#ifdef MM_SLAB
+    /* test runs with free slots */
+    for (i = 0; i < N_SLAB; i++){
+        struct run *r;
+        unsigned int nfree;
+        int w;
+        for (r = a->slab[i]; r; r = r->next){
+            if (!IS_SLAB(r) || r->cls_sz != (i + 1) << 3){
+                printf("bad run. 0x%lx\n", (unsigned long)r);
                 make_error(NULL);
             }
-            if (HEADER(blk) & 1){
-                printf("allocated blk in free list. 0x%lx\n", (unsigned long)blk);
+            for (nfree = 0, w = 0; w < RUN_SZ / 8 / 64; w++)
+                nfree += __builtin_popcountll(r->map[w]);
+            if (!nfree || nfree != r->nfree || nfree > r->nobj){
+                printf("wrong free count in run. 0x%lx\n", (unsigned long)r);
                 make_error(NULL);
             }
-            blk_sz = BLK_SZ(blk);
-            if (blk_sz < LBLK_SZ(i) || (i + 1 < N_LBLK && blk_sz >= LBLK_SZ(i + 1))){
-                printf("wrong block size. 0x%lx\n", (unsigned long)blk);
+            if (r->next && r->next->prev != r){
+                printf("double link error. 0x%lx\n", (unsigned long)r);
                 make_error(NULL);
             }
-            if (L_PREV(blk) && L_NEXT(L_PREV(blk)) != blk){
-                printf("double link error. 0x%lx\n", (unsigned long)blk);
+        }
+    }
+#endif
+#ifdef MM_QUICK
+    /* test quick bins: blocks stay allocated until merged */
+    for (i = 0; i < N_SBLK; i++){
+        blk = OFF_BLK(a->quick[i]);
+        if (!blk != !(a->quick_map & (1u << i))){
+            printf("quick bin %d: wrong bitmap\n", i);
+            make_error(NULL);
+        }
+        for (; blk; blk = OFF_BLK(L_NEXT(blk))){
+            if (blk <= prologue || blk >= high){
+                printf("outside boundary. 0x%lx\n", (unsigned long)blk);
+                make_error(NULL);
+            }
+            if (!(HEADER(blk) & 1) || BLK_SZ(blk) != SBLK_SZ(i)){
+                printf("bad blk in quick bin. 0x%lx\n", (unsigned long)blk);
                 make_error(NULL);
             }
-            blk = L_NEXT(blk);
         }
     }
-    /* test header/footer of all blocks */
-    blk = prologue;
-    while (1){
-        if (blk < prologue){
-            printf("outside low boundary 0x%lx\n", (unsigned long)blk);
+#endif
+    return n;
+}
+
+#ifdef MM_LIFE
+/* test the objects of nursery n against its live count */
+static void check_nursery(struct nursery *n){
+    void *p, *end = VPTR(n) + n->top;
+    unsigned int live = 0;
+    if (n->top < sizeof(struct nursery) || n->top > NURSERY_SZ - 8){
+        printf("nursery top out of range. 0x%lx\n", (unsigned long)n);
+        make_error(NULL);
+    }
+    for (p = VPTR(n) + 16; p - 8 < end; p += PAYLD_SZ(p) + 8){
+        if (PAYLD_SZ(p) == 0 || PAYLD_SZ(p) > LIFE_MAX || p + PAYLD_SZ(p) > end){
+            printf("bad object in nursery. 0x%lx\n", (unsigned long)p);
             make_error(NULL);
         }
+        live += HEADER(p) & 1;
+    }
+    if (live != n->live){
+        printf("wrong live count in nursery. 0x%lx\n", (unsigned long)n);
+        make_error(NULL);
+    }
+}
+#endif
+
+static void checkheap(int verbose){
+    void *blk = prologue;
+    void *high = mem_heap_hi() + 1;
+    void *next;
+    unsigned int listed = 0, n_free = 0;
+    int i, prev_alloc = 1;
+    verbose = verbose;
+    for (i = 0; i < MM_ARENAS; i++){
+        if (arenas[i].epilogue && arenas[i].epilogue + 4 > high){
+            printf("epilogue outside boundary.");
+            make_error(NULL);
+        }
+        listed += check_lists(&arenas[i], high);
+    }
+    /* test header/footer of all blocks, chunk by chunk */
+    while (1){
         if (((unsigned long)blk & 7ul)){
             printf("unaligned blk at 0x%lx\n", (unsigned long)blk);
             make_error(NULL);
         }
-        blk_sz = BLK_SZ(blk);
-        next = blk + blk_sz;
-        if (next > epilogue){
+        next = blk + BLK_SZ(blk);
+        if (next + 4 > high){
             printf("next blk outside high boundary 0x%lx. corrupted header.\n", (unsigned long)blk);
             make_error(NULL);
         }
-        if ((HEADER(blk) & 2) == 0 && HEADER(blk) != EVAL4B(next - 8)){
-            printf("footer/header unequal. 0x%lx\n", (unsigned long)blk);
+        /* only free blocks have footers */
+        if ((HEADER(blk) & 1) == 0){
+            if (PAYLD_SZ(blk) != EVAL4B(next - 8)){
+                printf("footer/header unequal. 0x%lx\n", (unsigned long)blk);
+                make_error(NULL);
+            }
+            if (!prev_alloc){
+                printf("two free blocks in a row. 0x%lx\n", (unsigned long)blk);
+                make_error(NULL);
+            }
+            n_free++;
+        }
+#ifdef MM_LIFE
+        else if (IS_NURSERY(blk))
+            check_nursery(blk);
+#endif
+        prev_alloc = HEADER(blk) & 1;
+        if (!(HEADER(next) & 2) != !prev_alloc){
+            printf("wrong prev alloc bit. 0x%lx\n", (unsigned long)next);
             make_error(NULL);
         }
         blk = next;
-        if (next == epilogue)
-            break;
+        if (PAYLD_SZ(blk) == 0){
+            /* epilogue: the heap ends, or the next chunk's prologue follows */
+            if ((HEADER(blk) & 1) == 0){
+                printf("bad epilogue. 0x%lx\n", (unsigned long)blk);
+                make_error(NULL);
+            }
+            if (blk + 8 >= high)
+                break;
+            blk += 16;
+            prev_alloc = 1;
+        }
     }
-}
\ No newline at end of file
+    if (listed != n_free){
+        printf("%u free blocks, %u in free lists\n", n_free, listed);
+        make_error(NULL);
+    }
+}
@@ -7,6 +7,9 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t align, size_t size);
 
 #else
 
@@ -15,6 +18,9 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t align, size_t size);
+extern void *aligned_alloc(size_t align, size_t size);
+extern int posix_memalign(void **memptr, size_t align, size_t size);
 
 #endif
 
@@ -23,3 +29,8 @@ extern int mm_init(void);
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
+
+#ifdef MM_STATS
+/* write the allocation statistics since mm_init as JSON, see README */
+extern void mm_stats_dump(FILE *fp);
+#endif
@@ -0,0 +1,165 @@
+/*
+ * region-bench.c - throughput of regions against mm_malloc/mm_free.
+ *
+ * simulates request-scoped work: every request allocates a number of
+ * objects, writes to each, then drops them all. the objects of a
+ * request are freed one by one with mm_free, in allocation order, or
+ * go away with a single mm_region_destroy. reports nanoseconds per
+ * object of each, best of several runs on a fresh heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "region.h"
+
+/* request patterns benchmarked */
+static const struct pattern{
+    const char *name;
+    int nobj;           /* objects per request */
+    int min, max;       /* object sizes, uniform */
+} patterns[] = {
+    {"tokens", 1000, 16, 128},      /* a parser's small nodes */
+    {"mixed", 200, 16, 1024},       /* a request's buffers and records */
+    {"fixed", 5000, 32, 32},        /* many equal objects */
+};
+#define N_PATTERNS ((int)(sizeof(patterns) / sizeof(patterns[0])))
+
+/* global vars */
+long total = 1000000;
+int repeat = 5;
+int *sizes;
+void **objs;
+
+void usage(char *argv[]){
+    printf("Usage: %s [-h] [-n <num>] [-k <num>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -n <num>   Objects allocated per pattern (default 1000000).\n");
+    printf("  -k <num>   Keep the best of num runs (default 5).\n");
+}
+
+/* parse command-line options using get-opt */
+void get_input(int argc, char *argv[]){
+    int optc = 0;
+    while((optc = getopt(argc, argv, "n:k:h")) != -1){
+        switch (optc) {
+            case 'n':
+                total = atol(optarg);
+                break;
+            case 'k':
+                repeat = atoi(optarg);
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+    if (repeat < 1)
+        repeat = 1;
+}
+
+double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* start over on an empty heap */
+void fresh_heap(void){
+    mem_reset_brk();
+    if (mm_init() < 0){
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+}
+
+/* seconds for nreq requests of pattern p with mm_malloc/mm_free */
+double run_malloc(const struct pattern *p, long nreq){
+    long i;
+    int j;
+    double t0;
+    fresh_heap();
+    t0 = now();
+    for (i = 0; i < nreq; i++){
+        for (j = 0; j < p->nobj; j++){
+            if ((objs[j] = mm_malloc(sizes[j])) == NULL){
+                fprintf(stderr, "mm_malloc failed\n");
+                exit(1);
+            }
+            *(int*)objs[j] = j;
+        }
+        for (j = 0; j < p->nobj; j++)
+            mm_free(objs[j]);
+    }
+    return now() - t0;
+}
+
+/* seconds for nreq requests of pattern p in regions */
+double run_region(const struct pattern *p, long nreq){
+    struct region *r;
+    long i;
+    int j;
+    double t0;
+    fresh_heap();
+    t0 = now();
+    for (i = 0; i < nreq; i++){
+        if ((r = mm_region_create()) == NULL){
+            fprintf(stderr, "mm_region_create failed\n");
+            exit(1);
+        }
+        for (j = 0; j < p->nobj; j++){
+            if ((objs[j] = mm_region_alloc(r, sizes[j])) == NULL){
+                fprintf(stderr, "mm_region_alloc failed\n");
+                exit(1);
+            }
+            *(int*)objs[j] = j;
+        }
+        mm_region_destroy(r);
+    }
+    return now() - t0;
+}
+
+/* main routine */
+int main(int argc, char *argv[])
+{
+    const struct pattern *p;
+    double t, best_m, best_r;
+    long nreq;
+    int i, j, k;
+    get_input(argc, argv);
+    mem_init();
+
+    printf("%-8s %8s %10s %12s %12s %8s\n", "pattern", "objects",
+            "sizes", "malloc ns", "region ns", "speedup");
+    for (i = 0; i < N_PATTERNS; i++){
+        p = &patterns[i];
+        nreq = total / p->nobj > 0 ? total / p->nobj : 1;
+        sizes = malloc(p->nobj * sizeof(int));
+        objs = malloc(p->nobj * sizeof(void*));
+        srand(i + 1);
+        for (j = 0; j < p->nobj; j++)
+            sizes[j] = p->min + rand() % (p->max - p->min + 1);
+        best_m = best_r = 1e30;
+        for (k = 0; k < repeat; k++){
+            if ((t = run_malloc(p, nreq)) < best_m)
+                best_m = t;
+            if ((t = run_region(p, nreq)) < best_r)
+                best_r = t;
+        }
+        printf("%-8s %8d %5d-%-4d %12.1f %12.1f %7.2fx\n", p->name, p->nobj,
+                p->min, p->max, best_m * 1e9 / (nreq * p->nobj),
+                best_r * 1e9 / (nreq * p->nobj), best_m / best_r);
+        free(sizes);
+        free(objs);
+    }
+    mem_deinit();
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * region.c - regions on top of the malloc package.
+ *
+ * a region takes chunks of REGION_CHUNK bytes from the heap and hands
+ * out objects by bumping a pointer through the current chunk. objects
+ * are never freed one by one: mm_region_destroy gives every chunk back
+ * to the heap, one free per chunk instead of one per object. requests
+ * over REGION_BIG bytes get a chunk of their own, so that they do not
+ * waste the rest of the current chunk.
+ *
+ * the chunks of a region form a list, newest first. the first chunk
+ * also holds the region itself, and is freed last:
+ *
+ *  ----|------|------ objects ...
+ *  next|region|
+ *  ----|------|------
+ *  8    24
+ */
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mm.h"
+#include "region.h"
+
+#ifdef DRIVER
+#define malloc mm_malloc
+#define free mm_free
+#endif /* def DRIVER */
+
+/* bytes taken from the heap at a time */
+#ifndef REGION_CHUNK
+# define REGION_CHUNK 4096
+#endif
+
+/* larger requests get a chunk of their own */
+#define REGION_BIG (REGION_CHUNK / 4)
+
+/* rounds up to the nearest multiple of 8 */
+#define ALIGN(p) (((size_t)(p) + 7) & ~0x7)
+
+struct chunk{
+    struct chunk *next;
+};
+
+struct region{
+/* chunks, newest first */
+    struct chunk *chunks;
+/* free space of the current chunk */
+    char *cur, *end;
+};
+
+struct region *mm_region_create(void){
+    struct chunk *c = malloc(REGION_CHUNK);
+    struct region *r;
+    if (!c)
+        return NULL;
+    c->next = NULL;
+    r = (struct region*)(c + 1);
+    r->chunks = c;
+    r->cur = (char*)(r + 1);
+    r->end = (char*)c + REGION_CHUNK;
+    return r;
+}
+
+void *mm_region_alloc(struct region *r, size_t size){
+    struct chunk *c;
+    void *p;
+    /* rounding up and the chunk header must not wrap */
+    if (size > SIZE_MAX - REGION_CHUNK)
+        return NULL;
+    size = ALIGN(size);
+    if (size <= (size_t)(r->end - r->cur)){
+        p = r->cur;
+        r->cur += size;
+        return p;
+    }
+    if (size > REGION_BIG){
+        if ((c = malloc(sizeof(struct chunk) + size)) == NULL)
+            return NULL;
+        c->next = r->chunks;
+        r->chunks = c;
+        return c + 1;
+    }
+    /* the rest of the current chunk is lost */
+    if ((c = malloc(REGION_CHUNK)) == NULL)
+        return NULL;
+    c->next = r->chunks;
+    r->chunks = c;
+    p = c + 1;
+    r->cur = (char*)p + size;
+    r->end = (char*)c + REGION_CHUNK;
+    return p;
+}
+
+void mm_region_destroy(struct region *r){
+    struct chunk *c = r->chunks, *next;
+    /* the region lives in the last chunk */
+    for (; c; c = next){
+        next = c->next;
+        free(c);
+    }
+}
@@ -0,0 +1,17 @@
+/*
+ * region.h - regions: objects bump-allocated from chunks of the heap
+ * and freed all at once.
+ */
+#include <stddef.h>
+
+struct region;
+
+/* a new, empty region, or NULL if the heap is exhausted */
+extern struct region *mm_region_create(void);
+
+/* size bytes, 8-byte aligned, that live until the region is destroyed,
+ * or NULL if they cannot be had */
+extern void *mm_region_alloc(struct region *r, size_t size);
+
+/* free every object of the region, and the region itself */
+extern void mm_region_destroy(struct region *r);